@@ -1,18 +0,0 @@
-/********************************************************************\
-
-  Name:         dd_mcfd16.h
-  Created by:   Kolby Kiesling
-
-  Contents:     Device driver function declarations for Mesytec MCFD16.
-
-  $Id: $
-
-\********************************************************************/
-#ifdef __cplusplus
-extern "C" {
-#endif
-INT dd_mcfd16(INT cmd, ...);
-#ifdef __cplusplus
-}
-#endif
-
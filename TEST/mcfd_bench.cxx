@@ -0,0 +1,224 @@
+//********************************************************************
+//
+//  Name:         mcfd_bench.cxx
+//  Created by:   Kolby Kiesling
+//
+//  Contents:     Micro-benchmark for the MCFD16 rate parser, the old
+//                string helpers and the reply framing code, fed from
+//                a recorded rs232 bus log, and for the per-sweep
+//                derived quantities.  Does not need MIDAS.
+//
+//                usage: mcfd_bench [-n passes] [rs232.log]
+//
+//  $Id: $
+//
+//********************************************************************
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <new>
+#include "mcfd_legacy.h"
+#include "mcfd_parse.h"
+#include "mcfd_channels.h"
+using namespace std;
+
+
+static long allocations = 0; // every operator new in the process is counted here
+
+// kept out of line, otherwise gcc sees malloc() behind operator new and warns about delete
+__attribute__((noinline)) void* operator new(size_t size) {
+  allocations++;
+  void* p = malloc(size ? size : 1);
+  if (p == NULL)
+    throw std::bad_alloc();
+  return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
+
+
+typedef struct {
+  vector<string> lines;        // every string one BD_GETS returned
+  vector<string> commands;     // every string passed to BD_PUTS
+  vector<string> frames;       // everything received after commands[i], up to and including the prompt
+} CORPUS;
+
+// The MIDAS rs232 bus driver logs ``puts: <str>\n'' for every write and
+// ``getstr <pattern>: <str>\n'' for every read.  The pattern itself can contain a newline,
+// so a record only ends where the next one starts.
+bool load_corpus(const char* path, CORPUS* corpus) {
+  FILE* f = fopen(path, "rb");
+  if (f == NULL)
+    return false;
+  string s;
+  char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    s.append(buf, n);
+  fclose(f);
+
+  size_t pos = 0;
+  while (pos < s.size()) {
+    bool is_puts = s.compare(pos, 6, "puts: ") == 0;
+    size_t start = is_puts ? pos+6 : s.find(": ", pos);
+    if (start == string::npos)
+      break;
+    if (!is_puts)
+      start += 2;
+
+    size_t next = min(s.find("\nputs: ", start), s.find("\ngetstr ", start));
+    size_t stop = next == string::npos ? s.size() : next;
+    string payload = s.substr(start, stop-start);
+    if (!payload.empty() && payload[payload.size()-1] == '\n')
+      payload.erase(payload.size()-1); // added by the logger
+
+    if (is_puts) {
+      corpus->commands.push_back(payload);
+      corpus->frames.push_back("");
+    }
+    else {
+      corpus->lines.push_back(payload);
+      if (!corpus->frames.empty())
+        corpus->frames.back() += payload;
+    }
+    pos = next == string::npos ? s.size() : next+1;
+  }
+
+  // The log was taken with ``\n'' as the read pattern, so most replies were cut before
+  // their prompt.  The driver now always reads up to the prompt; put it back.
+  for (size_t i=0; i<corpus->frames.size(); ++i)
+    if (corpus->frames[i].find(MCFD_PROMPT) == string::npos)
+      corpus->frames[i] += MCFD_PROMPT;
+  return true;
+}
+
+
+static volatile double sink; // keeps the optimiser from dropping the work
+
+template <class F>
+void bench(const char* name, const char* unit, size_t items, int passes, F f) {
+  double sum = 0;
+  long allocs = allocations;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (int p=0; p<passes; ++p)
+    for (size_t i=0; i<items; ++i)
+      sum += f(i);
+  chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+  allocs = allocations - allocs;
+  sink = sum;
+
+  double calls = (double) items * passes;
+  double ns = chrono::duration<double, nano>(stop - start).count() / calls;
+  printf("%-28s %-6s %10.0f %10.1f %12.0f %10.2f\n", name, unit, calls, ns, 1e9/ns, allocs/calls);
+}
+
+
+int main(int argc, char** argv) {
+  const char* path = "rs232.log";
+  int passes = 1;
+  for (int i=1; i<argc; ++i) {
+    if (strcmp(argv[i], "-n") == 0 && i+1 < argc)
+      passes = atoi(argv[++i]);
+    else
+      path = argv[i];
+  }
+  if (passes < 1)
+    passes = 1;
+
+  CORPUS corpus;
+  if (!load_corpus(path, &corpus)) {
+    fprintf(stderr, "Cannot open ``%s''\n", path);
+    return 1;
+  }
+  const vector<string>& lines = corpus.lines;
+  const vector<string>& frames = corpus.frames;
+  const vector<string>& commands = corpus.commands;
+  printf("corpus %s: %zu lines, %zu frames, %d pass(es)\n\n", path, lines.size(), frames.size(), passes);
+
+  // Results must agree before the timings mean anything
+  long differ_lines = 0, differ_frames = 0, rates = 0;
+  for (size_t i=0; i<lines.size(); ++i) {
+    MCFD_RATE r;
+    mcfd_parse_rate_line(lines[i].data(), lines[i].size(), &r);
+    float old = cut_string_frq(lines[i]);
+    if (r.status == MCFD_PARSE_OK)
+      rates++;
+    if (old != r.rate && !(old < 0 && r.rate < 0))
+      differ_lines++;
+  }
+  for (size_t i=0; i<frames.size(); ++i) {
+    MCFD_RATE r;
+    mcfd_parse_rate(frames[i].data(), frames[i].size(), &r);
+    float old = mcfd_get(frames[i]);
+    if (old != r.rate && !(old < 0 && r.rate < 0))
+      differ_frames++;
+  }
+  printf("%ld rate lines, %ld line(s) and %ld frame(s) where old and new parser differ\n\n", rates, differ_lines, differ_frames);
+
+  printf("%-28s %-6s %10s %10s %12s %10s\n", "benchmark", "input", "calls", "ns/call", "calls/s", "allocs/call");
+  bench("cut_string_frq (regex)", "line", lines.size(), passes, [&](size_t i) {
+    return (double) cut_string_frq(lines[i]); });
+  bench("mcfd_get (regex)", "frame", frames.size(), passes, [&](size_t i) {
+    return (double) mcfd_get(frames[i]); });
+  bench("removeChar", "line", lines.size(), passes, [&](size_t i) {
+    return (double) removeChar(lines[i]).size(); });
+  bench("removeSpaces", "line", lines.size(), passes, [&](size_t i) {
+    return (double) removeSpaces(lines[i]).size(); });
+  bench("shiftDigits", "line", lines.size(), passes, [&](size_t i) {
+    return (double) shiftDigits(lines[i]).size(); });
+  bench("mcfd_parse_rate_line", "line", lines.size(), passes, [&](size_t i) {
+    MCFD_RATE r;
+    mcfd_parse_rate_line(lines[i].data(), lines[i].size(), &r);
+    return (double) r.rate; });
+  bench("mcfd_parse_rate", "frame", frames.size(), passes, [&](size_t i) {
+    MCFD_RATE r;
+    mcfd_parse_rate(frames[i].data(), frames[i].size(), &r);
+    return (double) r.rate; });
+  bench("mcfd_echo_matches", "frame", frames.size(), passes, [&](size_t i) {
+    return (double) mcfd_echo_matches(frames[i].c_str(), commands[i].c_str()); });
+
+  // Receive path as the driver runs it: bytes land in the ring (a read()), the reply is
+  // framed on the prompt and parsed in place.  Wraps the ring every ~100 frames.
+  static MCFD_RING ring;
+  ring.reset();
+  bench("MCFD_RING frame + parse", "frame", frames.size(), passes, [&](size_t i) {
+    const string& f = frames[i];
+    for (size_t done=0; done < f.size(); ) {
+      int space;
+      char* dst = ring.write_ptr(&space);
+      int n = min((int) (f.size() - done), space);
+      memcpy(dst, f.data() + done, n);
+      ring.commit(n);
+      done += n;
+    }
+    int scanned = 0;
+    int len = ring.find(MCFD_PROMPT, strlen(MCFD_PROMPT), &scanned);
+    MCFD_VIEW reply = ring.take(len >= 0 ? len : ring.used());
+    MCFD_RATE r;
+    mcfd_parse_rate(reply.data, reply.len, &r);
+    ring.take(ring.used()); // a few logged frames hold two prompts, drop the rest
+    return (double) r.rate; });
+
+  // Derived quantities of one sweep, over every input at once.  The rates change with
+  // every call so nothing can be hoisted out of the loop.
+  static MCFD_CHANNELS ch;
+  int dead_time[MCFD_PAIRS], width[MCFD_PAIRS];
+  for (int k=0; k<MCFD_PAIRS; ++k) {
+    dead_time[k] = 27 + 10*k;
+    width[k] = 16 + 20*k;
+  }
+  mcfd_channels_reset(&ch);
+  mcfd_set_dead_time(&ch, dead_time, width);
+  bench("mcfd_derive", "sweep", 1000, passes, [&](size_t i) {
+    for (int c=0; c<MCFD_NUM_RATES; ++c)
+      ch.rate[c] = 1e3f * (c + 1) + i;
+    ch.rate[MCFD_SUM_RATE] = 2e5f + i;
+    mcfd_derive(&ch);
+    return (double) ch.ratio[i % MCFD_INPUTS] + ch.asymmetry[i % MCFD_PAIRS] + ch.corrected[i % MCFD_INPUTS]; });
+
+  return 0;
+}
@@ -0,0 +1,154 @@
+//********************************************************************
+//
+//  Name:         mcfd_ds_check.cxx
+//  Created by:   Kolby Kiesling
+//
+//  Contents:     Feeds ``ds'' replies through mcfd_read_shadow() of the
+//                driver and checks every register slot: the reply of
+//                rs232.log (mcfd_ds_log.h), which is missing bytes and
+//                must not count as read back, and a complete one in the
+//                same layout, which has to come back register for
+//                register.  The driver is built for MCFD_BUS with a bus
+//                driver here that plays the module.  Exits 1 on the
+//                first case that fails.
+//
+//                usage: mcfd_ds_check
+//
+//  $Id: $
+//
+//********************************************************************
+#include "../dd_mcfd16.cxx"
+#include "mcfd_ds_log.h"
+
+
+static const char* payload = "";   // what the module sends between echo and prompt
+static char last_cmd[32];
+
+// Answers every command with its echo, payload and the prompt, the way the module does
+INT module_bus(INT cmd, ...) {
+  va_list argptr;
+  va_start(argptr, cmd);
+  INT status = SUCCESS;
+  va_arg(argptr, void *); // info
+  if (cmd == CMD_PUTS) {
+    const char* str = va_arg(argptr, const char *);
+    snprintf(last_cmd, sizeof(last_cmd), "%.*s", (int) strcspn(str, "\r\n"), str);
+    status = strlen(str);
+  }
+  else if (cmd == CMD_GETS) {
+    char* buf = va_arg(argptr, char *);
+    int size = va_arg(argptr, int);
+    snprintf(buf, size, "%s\n\r\n%s%s", last_cmd, payload, MCFD_PROMPT);
+    status = strlen(buf);
+  }
+  va_end(argptr);
+  return status;
+}
+
+// A complete dump in the layout of the logged one, every register different from its
+// neighbours, and the settings it stands for
+static const char* complete =
+  "Threshold:     1 2 3 4 5 6 7 8 \r\n"
+  " 9 10 11 12 13 14 15 16 - 9\r\n"
+  "Polarity:      0 1 0 1 0 1 0 1 - 1\r\n"
+  "Gain:          0 1 2 0 1 2 0 1 - 1\r\n"
+  "Width:         16 17 18 19 20 21 22 23 - 16\r\n"
+  "Delay:         1 2 3 4 5 1 2 3 - 1\r\n"
+  "Dead time:     27 28 29 30 31 32 33 34 - 27\r\n"
+  "Fraction:      20 40 20 40 20 40 20 40 - 40\r\n"
+  "Pair coincidence: 1 2 3 4 5 6 7 8 \r\n"
+  " 9 10 11 12 13 14 15\r\n"
+  "Trigger source: 1 2 4\r\n"
+  "Trigger monitor: 3 5\r\n"
+  "Multiplicity:  2 16\r\n"
+  "Gate timing:   0 255\r\n"
+  "Gate select:   1\r\n"
+  "Coincidence:   36\r\n"
+  "Mask:          5\r\n"
+  "Veto:          1\r\n"
+  "BWL:           1\r\n"
+  "CFD:           0\r\n"
+  "Pulser:        2\r\n";
+
+void complete_settings(DD_MCFD_SETTINGS* s) {
+  static const int polarity[8] = { 0, 1, 0, 1, 0, 1, 0, 1 }, gain[8] = { 0, 1, 2, 0, 1, 2, 0, 1 };
+  static const int delay[8] = { 1, 2, 3, 4, 5, 1, 2, 3 }, source[3] = { 1, 2, 4 };
+  memset(s, 0, sizeof(*s));
+  for (int i=0; i<16; ++i)
+    s->set_threshold[i] = i+1;
+  for (int i=0; i<8; ++i) {
+    s->set_polarity[i] = polarity[i];
+    s->set_gain[i] = gain[i];
+    s->set_width[i] = 16+i;
+    s->set_delay_line[i] = delay[i];
+    s->set_dead_time[i] = 27+i;
+    s->set_fraction[i] = i%2 ? 40 : 20;
+  }
+  for (int i=0; i<15; ++i)
+    s->paired_coincidence[i] = i+1;
+  memcpy(s->trigger_source, source, sizeof(source));
+  s->trigger_monitor[0] = 3;
+  s->trigger_monitor[1] = 5;
+  s->set_multiplicity[0] = 2;
+  s->set_multiplicity[1] = 16;
+  s->gate_timing = 255;
+  s->gate_selector = 1;
+  s->set_coincidence = 36;
+  s->set_mask = 5;
+  s->set_veto = 1;
+  s->BWL = 1;
+  s->CFD = 0;
+  s->pulser = 2;
+}
+
+// Every slot: known exactly when want is given, and then reading back as want has it
+int check(DD_MCFD_INFO* info, const char* name, const DD_MCFD_SETTINGS* want) {
+  char have[32], expect[32];
+  int bad = 0;
+  int known = mcfd_read_shadow(info);
+  for (int slot=0; slot<MCFD_NUM_SLOTS; ++slot) {
+    bool is_known = mcfd_is_dirty(info->shadow_known, slot);
+    mcfd_format_slot(&info->shadow, slot, have, sizeof(have));
+    if (want == NULL && is_known) {
+      printf("  slot %2d: ``%.*s'' read back from a dump that does not have it\n", slot, (int) strcspn(have, "\r\n"), have);
+      bad++;
+      continue;
+    }
+    if (want == NULL)
+      continue;
+    mcfd_format_slot(want, slot, expect, sizeof(expect));
+    if (!is_known || strcmp(have, expect) != 0) {
+      printf("  slot %2d: want ``%.*s'', %s ``%.*s''\n", slot, (int) strcspn(expect, "\r\n"), expect,
+             is_known ? "read back" : "unknown, shadow", (int) strcspn(have, "\r\n"), have);
+      bad++;
+    }
+  }
+  printf("%s: %d of %d slots known, %d wrong\n", name, known, MCFD_NUM_SLOTS, bad);
+  return bad;
+}
+
+int main() {
+  static DD_MCFD_INFO info;
+  for (int c=0; c<MCFD_NUM_CLASSES; ++c)
+    mcfd_rtt_reset(&info.rtt[c], 1, DEFAULT_TIMEOUT);
+  info.bus.bd = module_bus;
+  info.bus.bd_info = &info;
+
+  // The Threshold block of the log goes on over a second line but has 12 values only
+  int values[16], common = -1;
+  int n = mcfd_parse_dump_group(MCFD_DS_LOGGED, strlen(MCFD_DS_LOGGED), "Threshold", values, 16, &common);
+  printf("logged Threshold block: %d values, common %d\n", n, common);
+  if (n != 12 || common != 9)
+    return 1;
+
+  payload = MCFD_DS_LOGGED;
+  if (check(&info, "logged ds reply", NULL) != 0 || info.dump_hash == 0)
+    return 1;
+
+  DD_MCFD_SETTINGS want;
+  complete_settings(&want);
+  payload = complete;
+  if (check(&info, "complete ds reply", &want) != 0 || info.dump_known != MCFD_NUM_SLOTS)
+    return 1;
+  return 0;
+}
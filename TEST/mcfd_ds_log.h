@@ -0,0 +1,28 @@
+//********************************************************************
+//
+//  Name:         mcfd_ds_log.h
+//  Created by:   Kolby Kiesling
+//
+//  Contents:     The ``ds'' reply of TEST/rs232.log (MCFD-16, firmware
+//                02.13), byte for byte from after the echo.  The log has
+//                no prompt after it; the module had lost bytes on the
+//                way (the same session reads `` version: 2.19''), so
+//                only the Threshold block is complete enough to show the
+//                layout, and not even that one has all 16 values.
+//                Shared by mcfd_sim and mcfd_ds_check.
+//
+//  $Id: $
+//
+//********************************************************************
+#ifndef MCFD_DS_LOG_H
+#define MCFD_DS_LOG_H
+
+#define MCFD_DS_LOGGED \
+  "Threshold:     0 0 0 0 0 0 0 0 \r\n" \
+  " 0 0 0 0 - 9\r\n" \
+  " 1 1 1 1 1 1 1 - 1\r\n" \
+  "6 6 6 6 - 6\r\n" \
+  "0 20 20 20 20 20 20 20 - 28\r\n" \
+  " 1 - 3\r\n"
+
+#endif
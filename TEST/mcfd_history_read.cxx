@@ -0,0 +1,83 @@
+//********************************************************************
+//
+//  Name:         mcfd_history_read.cxx
+//  Created by:   Kolby Kiesling
+//
+//  Contents:     Prints the rate history the driver keeps, see
+//                ../mcfd_history.h: one line per sweep of the last
+//                hours (1 unless -t is given), oldest first, with the
+//                time, the sweep number and duration and the rates.
+//                Maps the file read only, so it can run next to the
+//                frontend.  Does not need MIDAS.
+//
+//                usage: mcfd_history_read [-t hours] <device>.history
+//
+//  $Id: $
+//
+//********************************************************************
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include "mcfd_history.h"
+
+
+void print_record(const MCFD_HISTORY_RECORD* r) {
+  char when[32];
+  time_t t = (time_t) (r->time_ms / 1000);
+  strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&t));
+  printf("%s.%03u %10u %5u", when, (unsigned) (r->time_ms % 1000), r->sequence, r->duration_ms);
+  for (int i=0; i<MCFD_NUM_RATES; ++i) {
+    if (r->valid & (1u << i))
+      printf(" %9.1f", r->rate[i]);
+    else
+      printf(" %9s", "-");
+  }
+  printf("\n");
+}
+
+int main(int argc, char** argv) {
+  const char* path = NULL;
+  double hours = 1;
+  for (int i=1; i<argc; ++i) {
+    if (strcmp(argv[i], "-t") == 0 && i+1 < argc)
+      hours = atof(argv[++i]);
+    else
+      path = argv[i];
+  }
+  if (path == NULL) {
+    fprintf(stderr, "usage: mcfd_history_read [-t hours] <device>.history\n");
+    return 1;
+  }
+
+  MCFD_HISTORY h;
+  if (mcfd_history_open(&h, path, 0, true) != 0) {
+    fprintf(stderr, "``%s'' is not a rate history written with these structure sizes\n", path);
+    return 1;
+  }
+  unsigned long long head = mcfd_history_head(&h);
+  unsigned long long first = mcfd_history_first(&h);
+  unsigned long long since = mcfd_history_now_ms() - (unsigned long long) (hours * 3600e3);
+  printf("history \"%s\", %llu of %llu records\n", path, head - first, h.header->capacity);
+
+  // Back from the newest record to the first one older than the window
+  MCFD_HISTORY_RECORD r;
+  unsigned long long k = head;
+  while (k > first && mcfd_history_get(&h, k-1, &r) && r.time_ms >= since)
+    k--;
+  unsigned long long n = 0, lost = 0;
+  for (; k < head; ++k) {
+    if (!mcfd_history_get(&h, k, &r)) {
+      lost++; // overwritten by the frontend while reading
+      continue;
+    }
+    print_record(&r);
+    n++;
+  }
+  printf("%llu sweeps in the last %g hour(s)", n, hours);
+  if (lost)
+    printf(", %llu overwritten while reading", lost);
+  printf("\n");
+  mcfd_history_close(&h);
+  return 0;
+}
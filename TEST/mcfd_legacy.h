@@ -0,0 +1,140 @@
+/********************************************************************\
+
+  Name:         mcfd_legacy.h
+  Created by:   Kolby Kiesling
+
+  Contents:     The regex based rate parser that dd_mcfd16.cxx used
+                before mcfd_parse.h, kept only as the reference for
+                mcfd_bench.  Console output has been stripped so the
+                timings measure parsing alone.
+
+  $Id: $
+
+\********************************************************************/
+#ifndef MCFD_LEGACY_H
+#define MCFD_LEGACY_H
+
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+#include <regex>
+using namespace std;
+
+string removeChar (std::string str) {
+    int i=str.length();
+    int k=0;
+    while (k<=i) {
+      if ((str[k] > 57 || ((str[k] < 48) && str[k] != 46)) && str[k] != 0){
+	str[k]=0x20;
+      }
+      k++;
+    }
+    return str;
+}
+
+string removeSpaces (std::string str) {
+  str.erase(std::remove(str.begin(), str.end(),' '), str.end());
+  str.erase(std::remove(str.begin(), str.end(),'\n'), str.end());
+  str.erase(std::remove(str.begin(), str.end(),'\r'), str.end());
+  str.erase(std::remove(str.begin(), str.end(),'\t'), str.end());
+  str.erase(std::remove(str.begin(), str.end(),'\f'), str.end());
+  str.erase(std::remove(str.begin(), str.end(),'\v'), str.end());
+  return str;
+}
+
+string shiftDigits (std::string str) {
+  int i=str.length();
+  int k=0;
+  while (k<=i-3) { // seems to always have 3 initial blank spaces and 3 final blank spaces
+    if (str[k]==0)
+      str[k]=str[k+3];
+    k++;
+  }
+  return str; // may have to work on ending condition
+}
+
+float cut_string_frq(std::string str) {
+  regex chn_header("rate channel [0-9]*: ");
+  regex trg_header("trigger rate[0-9]*: ");
+  regex sum_header("sum rate : ");
+  regex chn_units(" Hz|kHz|MHz");
+  regex khz(" kHz");
+  regex hz(" Hz");
+  regex mhz(" MHz");
+  float frq=0, div=1; // frequency place holder and divider to catch units, report in kHz
+  bool found_header=false;
+  
+  smatch m;
+  if (regex_search(str, m, chn_header)) { // check for event header
+    str=std::regex_replace(str, chn_header, ""); // cut the header
+    found_header=true;
+  }
+  else if (regex_search(str, m, trg_header)) {
+    str=std::regex_replace(str, trg_header, ""); // cut the header
+    found_header=true;
+  }
+  else if (regex_search(str, m, sum_header)) {
+    str=std::regex_replace(str, sum_header, ""); // cut the header
+    found_header=true;
+  }
+  else
+    found_header=false;
+  if (found_header==true){
+    if (regex_search(str, m, chn_units)) {
+      if (regex_search(str, m, khz))
+	div=1000; // in the units we want
+      else if (regex_search(str, m, hz))
+	div=1; // divide by 1000 to return kHz
+      else if (regex_search(str, m, mhz))
+	div=1000000; // multiply by a thousand to get the right units
+      str=std::regex_replace(str, chn_units, "");
+      str=removeChar(str);
+      
+      frq=::atof(str.c_str());
+      
+      frq=frq*div; // set to kHz
+      return frq;
+    }
+  }
+  return -1; // does not find rate correctly...
+}
+
+float mcfd_get (std::string str) { // fetch our string and concatenate it to pass to cut_string
+  smatch m;
+  regex cmd_header("ra [0-9]*");
+  regex mcfd_ret("mcfd-16>");
+  regex chn_header("rate channel [0-9]*: ");
+  regex trg_header("trigger rate[0-9]*: ");
+  regex sum_header("sum rate : ");
+  bool found_event=false;
+  
+  for (size_t i=0;i<str.length();++i) { // TODO: check for cases where the cmd_header is not present... cut tail...
+    if (str[i]=='\n')
+      str[i]=0x20;
+    if (str[i]=='\r') // remove all characters that cause us problems
+      str[i]=0x20;
+  }
+  if (regex_search(str, m, cmd_header)) {
+    str=std::regex_replace(str, cmd_header, ""); // only cut the cmd because cut_string cares about everything else
+    found_event=true;
+  }
+  else if (regex_search(str, m, chn_header))
+    found_event=true; // we found a channel ID
+  else if (regex_search(str, m, trg_header))
+    found_event=true; // we found a trigger
+  else if (regex_search(str, m, sum_header))
+    found_event=true; // we found the sum of rates
+  else
+    found_event=false; // we could not find anything meaningful
+  
+  if (found_event) { // If we found a channel or event command, there should be the trailing edge mcfd-16> return
+    if (regex_search(str, m, mcfd_ret)) {
+	str=std::regex_replace(str, mcfd_ret, "");
+	return cut_string_frq(str);
+      }
+  }
+    
+  return -1; // something did not go right...
+}
+
+#endif
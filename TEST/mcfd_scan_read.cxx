@@ -0,0 +1,88 @@
+//********************************************************************
+//
+//  Name:         mcfd_scan_read.cxx
+//  Created by:   Kolby Kiesling
+//
+//  Contents:     Prints a scan file written by the driver, see
+//                ../mcfd_scan.h: the header, then one line per point
+//                with its values and the rates.  -p seeks straight to
+//                one point.  Does not need MIDAS.
+//
+//                usage: mcfd_scan_read [-p point] [mcfd_scan.dat]
+//
+//  $Id: $
+//
+//********************************************************************
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include "mcfd_scan.h"
+
+
+void print_record(const MCFD_SCAN_HEADER* h, const MCFD_SCAN_RECORD* r) {
+  printf("%6u %10u", r->point, r->time);
+  for (int d=0; d<h->ndims; ++d)
+    printf(" %6d", r->value[d]);
+  for (int i=0; i<MCFD_NUM_RATES; ++i) {
+    if (r->valid & (1u << i))
+      printf(" %9.1f", r->rate[i]);
+    else
+      printf(" %9s", "-");
+  }
+  printf("\n");
+}
+
+int main(int argc, char** argv) {
+  const char* path = "mcfd_scan.dat";
+  long only = -1;
+  for (int i=1; i<argc; ++i) {
+    if (strcmp(argv[i], "-p") == 0 && i+1 < argc)
+      only = atol(argv[++i]);
+    else
+      path = argv[i];
+  }
+
+  FILE* f = fopen(path, "rb");
+  if (f == NULL) {
+    fprintf(stderr, "Cannot open ``%s''\n", path);
+    return 1;
+  }
+  MCFD_SCAN_HEADER h;
+  if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, MCFD_SCAN_MAGIC, sizeof(h.magic)) != 0) {
+    fprintf(stderr, "``%s'' is not a scan file\n", path);
+    return 1;
+  }
+  if (h.header_size != sizeof(MCFD_SCAN_HEADER) || h.record_size != sizeof(MCFD_SCAN_RECORD)) {
+    fprintf(stderr, "``%s'' was written with other structure sizes (%u, %u)\n", path, h.header_size, h.record_size);
+    return 1;
+  }
+
+  printf("scan \"%s\", %u points, %u ms each, started %u\n", h.description, h.npoints, h.dwell_ms, h.start_time);
+  for (int d=0; d<h.ndims; ++d) {
+    printf("  %-20s channels 0x%04x, %d values:", h.dim[d].field, h.dim[d].channels, h.dim[d].n);
+    for (int k=0; k<h.dim[d].n; ++k)
+      printf(" %d", h.dim[d].value[k]);
+    printf("\n");
+  }
+
+  MCFD_SCAN_RECORD r;
+  if (only >= 0) {
+    if (only >= (long) h.npoints || fseek(f, h.header_size + only * h.record_size, SEEK_SET) != 0
+        || fread(&r, sizeof(r), 1, f) != 1) {
+      fprintf(stderr, "No record for point %ld\n", only);
+      return 1;
+    }
+    print_record(&h, &r);
+    return 0;
+  }
+  unsigned n = 0;
+  while (fread(&r, sizeof(r), 1, f) == 1) {
+    print_record(&h, &r);
+    n++;
+  }
+  if (n < h.npoints)
+    printf("%u of %u points, the scan did not finish\n", n, h.npoints);
+  fclose(f);
+  return 0;
+}
@@ -0,0 +1,469 @@
+//********************************************************************
+//
+//  Name:         mcfd_sim.cxx
+//  Created by:   Kolby Kiesling
+//
+//  Contents:     Mesytec MCFD16 simulator on a pseudo-terminal.  Point
+//                the rs232 bus driver's Device at the printed slave
+//                (or the -l link) to run the frontend without hardware.
+//                Does not need MIDAS.
+//
+//                usage: mcfd_sim [-b baud] [-d delay_ms] [-u uart_bytes]
+//                                [-x drop] [-c corrupt] [-s silent]
+//                                [-r seed] [-l link] [-f] [-v]
+//
+//  $Id: $
+//
+//********************************************************************
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <cmath>
+#include <ctime>
+#include <csignal>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <poll.h>
+#include <sys/time.h>
+#include "mcfd_ds_log.h"
+using namespace std;
+
+
+#define MCFD_PROMPT "mcfd-16>"
+
+
+typedef struct {
+  int baud;                    // line rate, 10 bits per byte on the wire
+  int delay_ms;                // processing time per command before the reply starts
+  int uart_bytes;              // input buffer of the module: bytes received but not yet executed, 0 = unlimited
+  double drop;                 // probability to lose an outgoing byte
+  double corrupt;              // probability to flip an outgoing byte
+  double silent;               // probability to ignore a whole command
+  const char* link;            // symlink to the slave, optional
+  bool full_dump;              // ds lists every register instead of replaying the logged reply
+  bool verbose;
+} SIM_SETTINGS;
+
+typedef struct {                 // everything the module remembers, same layout as the front panel
+  int threshold[16];
+  int polarity[8];
+  int gain[8];
+  int width[8];
+  int dead_time[8];
+  int delay_line[8];
+  int fraction[8];
+  int pair_coincidence[16];    // pa 1..15
+  int trigger_source[3];
+  int trigger_monitor[2];
+  int multiplicity[2];
+  int gate_timing[2];
+  int bwl, cfd, mask, coincidence, veto, gate_selector, pulser;
+  int common[7];               // common mode value of threshold, polarity .. fraction, only shown by ds
+  float noise[16];             // Hz at threshold 0, falls off with the threshold
+  float signal[16];            // Hz above the noise edge
+} SIM_MODULE;
+
+typedef struct {
+  long commands, silent, bytes_in, bytes_out, dropped, corrupted, overruns, misframed;
+} SIM_STATS;
+
+static SIM_SETTINGS sim;
+static SIM_MODULE module;
+static SIM_STATS stats;
+static volatile sig_atomic_t stop = 0;
+static int next_baud = 0;        // set by br, the reply still goes out at the old rate
+
+static const int baud_rates[] = { 9600, 19200, 38400, 57600, 115200 }; // br 1..5
+
+
+double now_s() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec*1e-6;
+}
+
+double chance() {
+  return rand() / (RAND_MAX + 1.0);
+}
+
+void module_reset() {
+  memset(&module, 0, sizeof(module));
+  for (int i=0; i<16; ++i) {
+    module.noise[i] = 2.5e6 * (1 + 0.1*i);   // every channel is a little noisier
+    module.signal[i] = 100 + 25*i;
+    module.pair_coincidence[i] = 255;
+  }
+  for (int i=0; i<8; ++i) {
+    module.polarity[i] = 1;
+    module.gain[i] = 1;
+    module.width[i] = 16;
+    module.dead_time[i] = 27;
+    module.delay_line[i] = 1;
+    module.fraction[i] = 40;
+  }
+  for (int i=0; i<3; ++i)
+    module.trigger_source[i] = 1;
+  module.multiplicity[1] = 16;
+  module.gate_timing[1] = 255;
+  module.bwl = module.cfd = 1;
+  module.coincidence = 36;
+  const int common[7] = { 9, 1, 1, 16, 1, 27, 40 };
+  memcpy(module.common, common, sizeof(common));
+}
+
+float channel_rate(int ch) {
+  float rate = module.signal[ch] + module.noise[ch] * exp(-module.threshold[ch] / 8.0);
+  if (module.pulser)
+    rate += module.pulser == 1 ? 2.5e6 : 1e3;
+  return rate;
+}
+
+// The module prints integers in Hz and three decimals in kHz or MHz
+void format_rate(char* out, size_t size, float hz) {
+  if (hz < 1e3)
+    snprintf(out, size, "%.0f Hz", hz);
+  else if (hz < 1e6)
+    snprintf(out, size, "%.3f kHz", hz/1e3);
+  else
+    snprintf(out, size, "%.3f MHz", hz/1e6);
+}
+
+
+void reply(string& out, const char* format, ...) {
+  char line[256];
+  va_list argptr;
+  va_start(argptr, format);
+  vsnprintf(line, sizeof(line), format, argptr);
+  va_end(argptr);
+  out += line;
+  out += "\r\n";
+}
+
+// One group of the full ds dump, laid out like the logged one (mcfd_ds_log.h): the label
+// padded to 15 columns, 8 values a line, the rest on unlabelled lines and `` - common''
+// at the end if the group has a common mode value (common >= 0)
+void reply_values(string& out, const char* label, const int* values, int n, int common=-1) {
+  char head[32];
+  snprintf(head, sizeof(head), "%-14s ", (string(label) + ":").c_str());
+  string line = head;
+  for (int i=0; i<n; ++i) {
+    if (i > 0 && i % 8 == 0) {
+      reply(out, "%s ", line.c_str());
+      line = "";
+    }
+    line += (i == 0 ? "" : " ") + to_string(values[i]);
+  }
+  if (common >= 0)
+    line += " - " + to_string(common);
+  reply(out, "%s", line.c_str());
+}
+
+// Execute one command line and build the complete answer: echo, payload lines, prompt
+string execute(const char* cmd) {
+  string out = string(cmd) + "\n\r\n";
+  char name[8] = "";
+  int a = 0, b = 0;
+  int n = sscanf(cmd, "%7[a-z] %d %d", name, &a, &b);
+  char rate[32];
+
+  if (n < 1) {
+    // empty line, just the prompt
+  }
+  else if (strcmp(name, "ra") == 0 && n >= 2 && a >= 0 && a < 20) {
+    if (a < 16) {
+      format_rate(rate, sizeof(rate), channel_rate(a));
+      reply(out, "rate channel %d: %s", a, rate);
+    }
+    else if (a < 19) {
+      float sum = 0;
+      for (int i=0; i<16; ++i)
+        if (module.trigger_source[a-16] & 1) // OR of all inputs
+          sum += channel_rate(i) / 16;
+      format_rate(rate, sizeof(rate), sum);
+      reply(out, "trigger rate%d: %s", a-16, rate);
+    }
+    else {
+      float sum = 0;
+      for (int i=0; i<16; ++i)
+        sum += channel_rate(i);
+      format_rate(rate, sizeof(rate), sum);
+      reply(out, "sum rate : %s", rate);
+    }
+  }
+  else if (strcmp(name, "st") == 0 && n == 3 && a >= 0 && a < 16) {
+    module.threshold[a] = b;
+    reply(out, "threshold channel %d set to %d", a, b);
+  }
+  else if (n == 3 && a >= 0 && a < 8 && strlen(name) == 2 && strchr("pgwydf", name[1]) && name[0] == 's') {
+    int* reg = NULL;
+    const char* what = "";
+    switch (name[1]) {
+      case 'p': reg = module.polarity; what = "polarity"; break;
+      case 'g': reg = module.gain; what = "gain"; break;
+      case 'w': reg = module.width; what = "width"; break;
+      case 'y': reg = module.delay_line; what = "delay"; break;
+      case 'd': reg = module.dead_time; what = "dead time"; break;
+      case 'f': reg = module.fraction; what = "fraction"; break;
+    }
+    reg[a] = b;
+    reply(out, "%s pair %d set to %d", what, a, b);
+  }
+  else if (strcmp(name, "pa") == 0 && n == 3 && a >= 1 && a < 16) {
+    module.pair_coincidence[a-1] = b;
+    reply(out, "pair coincidence %d set to %d", a, b);
+  }
+  else if (strcmp(name, "tr") == 0 && n == 3 && a >= 0 && a < 3) {
+    module.trigger_source[a] = b;
+    reply(out, "trigger source Trig%d set to: %d", a, b);
+  }
+  else if (strcmp(name, "tm") == 0 && n == 3) {
+    module.trigger_monitor[0] = a;
+    module.trigger_monitor[1] = b;
+  }
+  else if (strcmp(name, "sm") == 0 && n == 3) {
+    module.multiplicity[0] = a;
+    module.multiplicity[1] = b;
+  }
+  else if (strcmp(name, "ga") == 0 && n == 3 && (a == 0 || a == 1)) {
+    module.gate_timing[a] = b;
+  }
+  else if (n == 2 && strcmp(name, "bwl") == 0) module.bwl = a;
+  else if (n == 2 && strcmp(name, "cfd") == 0) module.cfd = a;
+  else if (n == 2 && strcmp(name, "sk") == 0) module.mask = a;
+  else if (n == 2 && strcmp(name, "sc") == 0) module.coincidence = a;
+  else if (n == 2 && strcmp(name, "sv") == 0) module.veto = a;
+  else if (n == 2 && strcmp(name, "gs") == 0) module.gate_selector = a;
+  else if (strcmp(name, "p") == 0 && n == 2 && a >= 0 && a <= 3) {
+    module.pulser = a;
+    reply(out, a == 0 ? "pulser off" : a == 1 ? "pulser fast on" : "pulser slow on");
+  }
+  else if (strcmp(name, "ds") == 0 && !sim.full_dump) {
+    out += MCFD_DS_LOGGED; // what a module sent once, whatever the registers hold
+  }
+  else if (strcmp(name, "ds") == 0) {
+    reply_values(out, "Threshold", module.threshold, 16, module.common[0]);
+    reply_values(out, "Polarity", module.polarity, 8, module.common[1]);
+    reply_values(out, "Gain", module.gain, 8, module.common[2]);
+    reply_values(out, "Width", module.width, 8, module.common[3]);
+    reply_values(out, "Delay", module.delay_line, 8, module.common[4]);
+    reply_values(out, "Dead time", module.dead_time, 8, module.common[5]);
+    reply_values(out, "Fraction", module.fraction, 8, module.common[6]);
+    reply_values(out, "Pair coincidence", module.pair_coincidence, 15);
+    reply_values(out, "Trigger source", module.trigger_source, 3);
+    reply_values(out, "Trigger monitor", module.trigger_monitor, 2);
+    reply_values(out, "Multiplicity", module.multiplicity, 2);
+    reply_values(out, "Gate timing", module.gate_timing, 2);
+    reply(out, "Gate select: %d", module.gate_selector);
+    reply(out, "Coincidence: %d", module.coincidence);
+    reply(out, "Mask: %d", module.mask);
+    reply(out, "Veto: %d", module.veto);
+    reply(out, "BWL: %d", module.bwl);
+    reply(out, "CFD: %d", module.cfd);
+    reply(out, "Pulser: %d", module.pulser);
+  }
+  else if (strcmp(name, "br") == 0 && n == 2 && a >= 1 && a <= 5) {
+    next_baud = baud_rates[a-1];
+    reply(out, "baud rate set to %d", next_baud);
+  }
+  else if (strcmp(name, "v") == 0) {
+    reply(out, "MCFD-16");
+    reply(out, "Firmware version: 02.13");
+    reply(out, "Software version: 2.19");
+  }
+  else {
+    reply(out, "Unknown command");
+  }
+
+  out += MCFD_PROMPT;
+  return out;
+}
+
+
+// Write at the configured line rate, with byte loss and corruption
+void send(int fd, const string& out) {
+  const double byte_time = sim.baud > 0 ? 10.0 / sim.baud : 0;
+  double t = now_s();
+  for (size_t i=0; i<out.size(); ++i) {
+    char c = out[i];
+    if (sim.drop > 0 && chance() < sim.drop) {
+      stats.dropped++;
+      continue;
+    }
+    if (sim.corrupt > 0 && chance() < sim.corrupt) {
+      c ^= 1 << (rand() % 7);
+      stats.corrupted++;
+    }
+    while (write(fd, &c, 1) != 1 && errno == EAGAIN)
+      usleep(100);
+    stats.bytes_out++;
+
+    t += byte_time;
+    double wait = t - now_s();
+    if (wait > 0.0005) // sleep in chunks, usleep cannot do single bytes at high rates
+      usleep((useconds_t) (wait*1e6));
+  }
+}
+
+
+// Line rate the client set on the slave, 0 if it cannot be read
+int client_baud(int slave) {
+  static const speed_t speed[] = { B9600, B19200, B38400, B57600, B115200 };
+  struct termios tio;
+  if (slave < 0 || tcgetattr(slave, &tio) != 0)
+    return 0;
+  for (int k=0; k<5; ++k)
+    if (cfgetospeed(&tio) == speed[k])
+      return baud_rates[k];
+  return -1;
+}
+
+void on_signal(int) {
+  stop = 1;
+}
+
+void usage() {
+  fprintf(stderr, "usage: mcfd_sim [-b baud] [-d delay_ms] [-u uart_bytes] [-x drop] [-c corrupt] [-s silent] [-r seed] [-l link] [-f] [-v]\n");
+  fprintf(stderr, "  -b  line rate in baud, the client has to use the same, 0 = as fast as the pty goes and any rate (default 9600)\n");
+  fprintf(stderr, "  -d  processing delay per command in ms (default 2)\n");
+  fprintf(stderr, "  -u  size of the module's input buffer; bytes that arrive while it is full are lost (default 0 = unlimited)\n");
+  fprintf(stderr, "  -x  probability to drop an outgoing byte\n");
+  fprintf(stderr, "  -c  probability to corrupt an outgoing byte\n");
+  fprintf(stderr, "  -s  probability to ignore a command completely\n");
+  fprintf(stderr, "  -l  create a symlink to the slave device, e.g. /tmp/ttyMCFD\n");
+  fprintf(stderr, "  -f  answer ds with every register in the logged layout, not with the reply logged in rs232.log\n");
+}
+
+
+int main(int argc, char** argv) {
+  sim.baud = 9600;
+  sim.delay_ms = 2;
+  unsigned seed = (unsigned) time(NULL);
+
+  int opt;
+  while ((opt = getopt(argc, argv, "b:d:u:x:c:s:r:l:fvh")) != -1) {
+    switch (opt) {
+      case 'b': sim.baud = atoi(optarg); break;
+      case 'd': sim.delay_ms = atoi(optarg); break;
+      case 'u': sim.uart_bytes = atoi(optarg); break;
+      case 'x': sim.drop = atof(optarg); break;
+      case 'c': sim.corrupt = atof(optarg); break;
+      case 's': sim.silent = atof(optarg); break;
+      case 'r': seed = (unsigned) atoi(optarg); break;
+      case 'l': sim.link = optarg; break;
+      case 'f': sim.full_dump = true; break;
+      case 'v': sim.verbose = true; break;
+      default: usage(); return 1;
+    }
+  }
+  srand(seed);
+  module_reset();
+
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    perror("posix_openpt");
+    return 1;
+  }
+  const char* slave_name = ptsname(master);
+
+  // Keep our own handle on the slave so the master does not see EIO while the
+  // frontend is restarting, and start it raw in case the client does not set it up.
+  int slave = open(slave_name, O_RDWR | O_NOCTTY);
+  struct termios tio;
+  if (slave >= 0 && tcgetattr(slave, &tio) == 0) {
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+  }
+
+  if (sim.link) {
+    unlink(sim.link);
+    if (symlink(slave_name, sim.link) != 0)
+      perror("symlink");
+  }
+  printf("MCFD16 simulator on %s%s%s, %d baud, %d ms per command\n", slave_name,
+         sim.link ? " -> " : "", sim.link ? sim.link : "", sim.baud, sim.delay_ms);
+  fflush(stdout);
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  // Bytes read from the pty are still on the wire until their line time has passed, then
+  // they go into the module's input buffer, where they wait until the command they belong
+  // to is executed.  Whatever arrives while that buffer is full is lost, just like in the
+  // module's UART when the host sends faster than the commands are worked off.
+  string wire, fifo;
+  double arrived = 0;            // wire time accounted for up to here
+  while (!stop) {
+    const double byte_time = sim.baud > 0 ? 10.0 / sim.baud : 0;
+    bool ready = fifo.find('\r') != string::npos;
+    int wait = ready ? 0 : wire.empty() ? 200 : 1 + (int) (byte_time * 1000);
+    struct pollfd pfd = { master, POLLIN, 0 };
+    if (poll(&pfd, 1, wait) > 0) {
+      char buf[256];
+      int n = read(master, buf, sizeof(buf));
+      if (n > 0) {
+        stats.bytes_in += n;
+        if (sim.baud > 0 && client_baud(slave) != sim.baud) { // framing errors only, nothing gets through
+          stats.misframed += n;
+          fifo.clear();
+        }
+        else {
+          if (wire.empty())
+            arrived = now_s();
+          wire.append(buf, n);
+        }
+      }
+    }
+
+    size_t k = wire.size();
+    if (byte_time > 0 && k > 0) {
+      k = min(k, (size_t) ((now_s() - arrived) / byte_time));
+      arrived += k * byte_time;
+    }
+    for (size_t j=0; j<k; ++j) {
+      if (sim.uart_bytes > 0 && (int) fifo.size() >= sim.uart_bytes)
+        stats.overruns++;
+      else
+        fifo += wire[j];
+    }
+    wire.erase(0, k);
+
+    size_t end = fifo.find('\r');
+    if (end == string::npos)
+      continue;
+    string line;
+    for (size_t j=0; j<end; ++j)
+      if (fifo[j] != '\n')
+        line += fifo[j];
+    fifo.erase(0, end+1);
+
+    stats.commands++;
+    if (sim.silent > 0 && chance() < sim.silent) {
+      stats.silent++;
+      continue;
+    }
+    if (sim.delay_ms > 0)
+      usleep(sim.delay_ms * 1000);
+    string out = execute(line.c_str());
+    if (sim.verbose)
+      printf("<< %s\n", line.c_str());
+    send(master, out);
+    if (next_baud) {
+      printf("now at %d baud\n", next_baud);
+      fflush(stdout);
+      sim.baud = next_baud;
+      next_baud = 0;
+    }
+  }
+
+  printf("\n%ld commands (%ld ignored), %ld bytes in (%ld at the wrong rate), %ld bytes out, %ld dropped, %ld corrupted, %ld overruns\n",
+         stats.commands, stats.silent, stats.bytes_in, stats.misframed, stats.bytes_out, stats.dropped, stats.corrupted, stats.overruns);
+  if (sim.link)
+    unlink(sim.link);
+  close(master);
+  return 0;
+}
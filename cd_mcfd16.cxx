@@ -0,0 +1,229 @@
+//********************************************************************
+//
+//  Name:         cd_mcfd16.cxx
+//  Created by:   Kolby Kiesling
+//
+//  Contents:     Class driver for Mesytec MCFD16.  cd_multi asks the
+//                device driver for every variable with its own CMD_GET
+//                and writes each one to the ODB on its own; this one
+//                takes the whole set from dd_mcfd16_snapshot() once
+//                per poll and, when any of it changed, writes it with
+//                one db_set_data.  Names are set once at init.
+//                Keeps the ODB layout of cd_multi (Variables/Input,
+//                Settings/Names Input), so history and custom pages
+//                do not change.  Every device driver of the equipment
+//                has to be dd_mcfd16; their variables follow each
+//                other in the order of the driver list.
+//
+//  $Id: $
+//
+//********************************************************************
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "midas.h"
+#include "dd_mcfd16.h"
+#include "cd_mcfd16.h"
+
+
+typedef struct {
+  INT num_channels;            // all drivers together
+  char *names;                 // NAME_LENGTH each
+  float *var;
+  float *var_odb;              // as last written to the ODB
+  DWORD *sequence;             // per driver, sweep its part of var belongs to
+  DWORD *bank_sequence;        // per driver, last sweep sent in an MCRT bank
+  INT num_drivers;
+  BOOL driver_error;           // shown in the equipment status
+  HNDLE hKeyRoot, hKeyVar;
+} MCFD_CD_INFO;
+
+
+INT cd_mcfd16_init(EQUIPMENT * pequipment)
+{
+  HNDLE hDB, hKey;
+  char str[256];
+  int status, i, offset;
+  DEVICE_DRIVER *driver = pequipment->driver;
+  MCFD_CD_INFO *info = (MCFD_CD_INFO *) calloc(1, sizeof(MCFD_CD_INFO));
+  pequipment->cd_info = info;
+
+  cm_get_experiment_database(&hDB, NULL);
+  sprintf(str, "/Equipment/%s", pequipment->name);
+  db_create_key(hDB, 0, str, TID_KEY);
+  db_find_key(hDB, 0, str, &info->hKeyRoot);
+
+  int num_drivers = 0;
+  for (i=0; driver[i].name[0]; ++i) {
+    info->num_channels += driver[i].channels;
+    num_drivers++;
+  }
+  if (info->num_channels == 0) {
+    cm_msg(MERROR, "cd_mcfd16_init", "No channels found in device driver list");
+    return FE_ERR_ODB;
+  }
+  info->names = (char *) calloc(info->num_channels, NAME_LENGTH);
+  info->var = (float *) calloc(info->num_channels, sizeof(float));
+  info->var_odb = (float *) calloc(info->num_channels, sizeof(float));
+  info->sequence = (DWORD *) calloc(num_drivers, sizeof(DWORD));
+  info->bank_sequence = (DWORD *) calloc(num_drivers, sizeof(DWORD));
+  info->num_drivers = num_drivers;
+
+  // Device drivers, each with its Settings/Devices/<name> subtree like under cd_multi
+  for (i=0; driver[i].name[0]; ++i) {
+    sprintf(str, "Settings/Devices/%s", driver[i].name);
+    if (db_find_key(hDB, info->hKeyRoot, str, &hKey) != DB_SUCCESS) {
+      db_create_key(hDB, info->hKeyRoot, str, TID_KEY);
+      db_find_key(hDB, info->hKeyRoot, str, &hKey);
+    }
+    driver[i].pequipment = &pequipment->info;
+    status = driver[i].dd(CMD_INIT, hKey, &driver[i].dd_info, driver[i].channels, driver[i].flags, driver[i].bd);
+    if (status != FE_SUCCESS) {
+      cm_msg(MERROR, "cd_mcfd16_init", "Device driver %s failed to initialise, status %d", driver[i].name, status);
+      set_equipment_status(pequipment->name, "Device driver error", "#FF0000");
+      return status;
+    }
+    driver[i].enabled = TRUE;
+  }
+
+  // Names once: the labels of the device driver, unless the ODB already has names
+  for (i=0, offset=0; driver[i].name[0]; offset += driver[i].channels, ++i)
+    for (int c=0; c<driver[i].channels; ++c)
+      driver[i].dd(CMD_GET_LABEL, driver[i].dd_info, c, info->names + (offset + c) * NAME_LENGTH);
+  db_merge_data(hDB, info->hKeyRoot, "Settings/Names Input", info->names, NAME_LENGTH * info->num_channels,
+                info->num_channels, TID_STRING);
+
+  for (i=0; i<info->num_channels; ++i)
+    info->var[i] = ss_nan();
+  db_merge_data(hDB, info->hKeyRoot, "Variables/Input", info->var, sizeof(float) * info->num_channels,
+                info->num_channels, TID_FLOAT);
+  memcpy(info->var_odb, info->var, sizeof(float) * info->num_channels);
+  db_find_key(hDB, info->hKeyRoot, "Variables/Input", &info->hKeyVar);
+
+  set_equipment_status(pequipment->name, "Ok", "#00FF00");
+  return FE_SUCCESS;
+}
+
+INT cd_mcfd16_exit(EQUIPMENT * pequipment)
+{
+  MCFD_CD_INFO *info = (MCFD_CD_INFO *) pequipment->cd_info;
+  for (int i=0; pequipment->driver[i].name[0]; ++i)
+    if (pequipment->driver[i].enabled)
+      pequipment->driver[i].dd(CMD_EXIT, pequipment->driver[i].dd_info);
+  if (info) {
+    free(info->names);
+    free(info->var);
+    free(info->var_odb);
+    free(info->sequence);
+    free(info->bank_sequence);
+    free(info);
+    pequipment->cd_info = NULL;
+  }
+  return FE_SUCCESS;
+}
+
+// One poll of every module; the variables go to the ODB in one piece, and only when one
+// of them changed: the rates and their statistics with each sweep, the lane metrics and
+// the line rate whenever the driver's traffic does
+INT cd_mcfd16_idle(EQUIPMENT * pequipment)
+{
+  HNDLE hDB;
+  MCFD_CD_INFO *info = (MCFD_CD_INFO *) pequipment->cd_info;
+  DEVICE_DRIVER *driver = pequipment->driver;
+  BOOL error = FALSE;
+
+  for (int i=0, offset=0; driver[i].name[0]; offset += driver[i].channels, ++i) {
+    if (!driver[i].enabled)
+      continue;
+    if (dd_mcfd16_snapshot(driver[i].dd_info, info->var + offset, driver[i].channels, &info->sequence[i]) != FE_SUCCESS)
+      error = TRUE;
+  }
+
+  if (error != info->driver_error) {
+    info->driver_error = error;
+    if (error)
+      set_equipment_status(pequipment->name, "Device driver error", "#FF0000");
+    else
+      set_equipment_status(pequipment->name, "Ok", "#00FF00");
+  }
+
+  // Bitwise, so that a NaN that stays NaN is no change
+  if (memcmp(info->var, info->var_odb, sizeof(float) * info->num_channels) == 0)
+    return FE_SUCCESS;
+  memcpy(info->var_odb, info->var, sizeof(float) * info->num_channels);
+
+  cm_get_experiment_database(&hDB, NULL);
+  db_set_data(hDB, info->hKeyVar, info->var, sizeof(float) * info->num_channels, info->num_channels, TID_FLOAT);
+  pequipment->odb_out++;
+  return FE_SUCCESS;
+}
+
+// Same INPT bank as cd_multi_read, from the last snapshot
+INT cd_mcfd16_read(char *pevent, int offset)
+{
+  float *pdata;
+  EQUIPMENT *pequipment = *((EQUIPMENT **) pevent);
+  MCFD_CD_INFO *info = (MCFD_CD_INFO *) pequipment->cd_info;
+
+  bk_init(pevent);
+  bk_create(pevent, "INPT", TID_FLOAT, (void **) &pdata);
+  memcpy(pdata, info->var, sizeof(float) * info->num_channels);
+  bk_close(pevent, pdata + info->num_channels);
+  return bk_size(pevent);
+}
+
+// MCRT bank for a periodic equipment next to the slow control one: one MCFD_RATE_BANK for
+// each module that finished a sweep since the last event, from the driver caches, so
+// the bus sees no extra traffic.  No event at all while there is no new sweep.
+INT cd_mcfd16_rate_bank(EQUIPMENT * pequipment, char *pevent)
+{
+  MCFD_CD_INFO *info = (MCFD_CD_INFO *) pequipment->cd_info;
+  DEVICE_DRIVER *driver = pequipment->driver;
+  MCFD_RATE_BANK rates, *pdata = NULL;
+
+  if (info == NULL)
+    return 0; // slow control equipment not initialised
+  for (int i=0; i<info->num_drivers; ++i) {
+    if (!driver[i].enabled || driver[i].dd_info == NULL)
+      continue;
+    dd_mcfd16_rates(driver[i].dd_info, &rates);
+    if (rates.sequence == info->bank_sequence[i])
+      continue;
+    info->bank_sequence[i] = rates.sequence;
+    rates.device = i;
+    if (pdata == NULL) {
+      bk_init32(pevent);
+      bk_create(pevent, "MCRT", TID_STRUCT, (void **) &pdata);
+    }
+    *pdata++ = rates;
+  }
+  if (pdata == NULL)
+    return 0;
+  bk_close(pevent, pdata);
+  return bk_size(pevent);
+}
+
+INT cd_mcfd16(INT cmd, PEQUIPMENT pequipment)
+{
+  INT status;
+
+  switch (cmd) {
+    case CMD_INIT:
+      status = cd_mcfd16_init(pequipment);
+      break;
+
+    case CMD_EXIT:
+      status = cd_mcfd16_exit(pequipment);
+      break;
+
+    case CMD_IDLE:
+      status = cd_mcfd16_idle(pequipment);
+      break;
+
+    default:
+      status = FE_SUCCESS; // CMD_START, CMD_STOP: nothing to do, readout goes on regardless of runs
+      break;
+  }
+
+  return status;
+}
@@ -0,0 +1,14 @@
+/********************************************************************\
+
+  Name:         cd_mcfd16.h
+  Created by:   Kolby Kiesling
+
+  Contents:     Class driver for Mesytec MCFD16, in place of cd_multi.
+
+  $Id: $
+
+\********************************************************************/
+
+INT cd_mcfd16(INT cmd, PEQUIPMENT pequipment);
+INT cd_mcfd16_read(char *pevent, int offset);
+INT cd_mcfd16_rate_bank(EQUIPMENT *pequipment, char *pevent); // MCRT bank of every module, see cd_mcfd16.cxx
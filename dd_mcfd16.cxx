@@ -3,51 +3,97 @@
 //  Name:         dd_mcfd16.cxx
 //  Created by:   Kolby Kiesling
 //
-//  Contents:     Device driver for Mesytec MCFD16
+//  Contents:     Device driver for Mesytec MCFD16.  Built once per
+//                transport from this one source, see mcfd_transport.h
 //
 //  $Id: $
 //
 //********************************************************************
-
+#include <string>
 #include <cstdio>
 #include <cstdlib>
 #include <cstdarg>
 #include <cstring>
+#include <cstddef>
 #include <cassert>
+#include <cctype>
 #include <cmath>
+#include <ctime>
 #include <algorithm>
 #include <iostream>
-
 #include "midas.h"
-
+#include "mcfd_parse.h"
+#include "mcfd_channels.h"
+#include "mcfd_scan.h"
+#include "mcfd_rtt.h"
+#include "mcfd_history.h"
+#include "mcfd_transport.h"
+#include "dd_mcfd16.h"
 #undef calloc
-
-
-
-#define DEFAULT_TIMEOUT 1000     // milliseconds
-
-
-#define CHAN_INP_POLARITY 0
-#define CHAN_INP_GAIN 1
-#define CHAN_INP_THRESHOLD 2
-#define CHAN_INP_WIDTH 3
-#define CHAN_INP_DEAD_TIME 4
-#define CHAN_INP_DELAY_LINE 5
-#define CHAN_INP_FRACTION 6
-#define CHAN_INP_TRIGGER_SOURCE 7
-#define CHAN_INP_TRIGGER_PATTERN 8
-#define CHAN_INP_MULTIPLICITY 9
-#define CHAN_INP_PAIRED_COINCIDENCE 10
-#define CHAN_INP_BWL 11
-#define CHAN_INP_CFD 12
-#define CHAN_INP_SET_MASK 13
-#define CHAN_INP_SET_COINCIDENCE 14
-#define CHAN_INP_SET_VETO 15
-#define CHAN_INP_GATE_SELECTOR 16
-#define CHAN_INP_GATE_TIMING 17
-#define CHAN_INP_PULSER 18
-#define CHAN_OUT_FREQUENCY 19
-#define CHAN_OUT_RE 20 // not known if this is necessary...
+using namespace std;
+
+
+#define DEFAULT_TIMEOUT 1000     // milliseconds, deadline for one complete reply until round trips were learned
+#define MCFD_PIPELINE_WINDOW 4   // commands in flight, ~40 bytes stays well inside the module's UART buffer
+#define MCFD_MAX_BATCH 128       // a full reconfiguration is MCFD_NUM_SLOTS commands
+#define MCFD_STARTUP_BUDGET 3000 // milliseconds for the whole startup handshake
+#define MCFD_FLUSH_QUIET 20      // milliseconds without a byte that count as an idle line
+#define MCFD_THRESHOLD_MAX 255   // highest value st takes
+#define MCFD_FINDER_RETRIES 3    // rate reads an input may miss before the finder gives it up
+#define MCFD_BAUD_PROBE 150      // milliseconds for the prompt while looking for the line rate
+#define MCFD_BAUD_BAD_SWEEPS 3   // bad sweeps in a row before a raised line rate is given up
+#define MCFD_CONFIG_RETRY_MIN 1000 // ms before unacknowledged settings are tried again, doubled up to
+#define MCFD_CONFIG_RETRY_MAX 60000 // this while they keep failing
+
+
+#define TRIGGER_0_OUT 16
+#define TRIGGER_1_OUT 17
+#define TRIGGER_2_OUT 18
+#define SUM_OUT 19
+
+
+#define MCFD_ALARM_OK 0
+#define MCFD_ALARM_LOW 1         // dead
+#define MCFD_ALARM_HIGH 2        // hot
+#define MCFD_ALARM_NOISY 3
+
+// Lanes of the bus scheduler, highest priority first, see mcfd_schedule()
+#define MCFD_LANE_CONTROL 0      // veto and pulser, written as soon as they change
+#define MCFD_LANE_POLL 1         // the rate sweep, once per read period
+#define MCFD_LANE_CONFIG 2       // every other register, a chunk at a time
+#define MCFD_NUM_LANES 3
+
+// Command classes with a reply deadline of their own, learned from their round trips
+#define MCFD_CLASS_RATE 0        // ra
+#define MCFD_CLASS_WRITE 1       // register writes, pipelined
+#define MCFD_CLASS_DUMP 2        // ds
+#define MCFD_NUM_CLASSES 3
+
+
+// Every register write the driver knows, one slot per command line.  Pair registers
+// (polarity, gain, width, delay, dead time, fraction) take the pair index, tm and sm
+// write two values in one command so both indices share a slot.
+#define MCFD_SLOT_THRESHOLD 0            // st <channel 0-15> <threshold>
+#define MCFD_SLOT_TRIGGER_SOURCE 16      // tr <trigger 0-2> <source>
+#define MCFD_SLOT_POLARITY 19            // sp <pair 0-7> <polarity>
+#define MCFD_SLOT_GAIN 27                // sg <pair> <gain>
+#define MCFD_SLOT_WIDTH 35               // sw <pair> <width>
+#define MCFD_SLOT_DELAY_LINE 43          // sy <pair> <delay>
+#define MCFD_SLOT_DEAD_TIME 51           // sd <pair> <dead time>
+#define MCFD_SLOT_FRACTION 59            // sf <pair> <fraction>
+#define MCFD_SLOT_PAIRED_COINCIDENCE 67  // pa <channel 1-15> <pattern>
+#define MCFD_SLOT_TRIGGER_MONITOR 82     // tm <monitor 0> <monitor 1>
+#define MCFD_SLOT_MULTIPLICITY 83        // sm <lower> <upper>
+#define MCFD_SLOT_BWL 84
+#define MCFD_SLOT_CFD 85
+#define MCFD_SLOT_MASK 86
+#define MCFD_SLOT_COINCIDENCE 87
+#define MCFD_SLOT_VETO 88
+#define MCFD_SLOT_GATE_SELECTOR 89
+#define MCFD_SLOT_GATE_TIMING 90
+#define MCFD_SLOT_PULSER 91
+#define MCFD_NUM_SLOTS 92
+#define MCFD_DIRTY_WORDS ((MCFD_NUM_SLOTS+31)/32)
 
 
 #define DD_MCFD_SETTINGS_STR "\
@@ -146,21 +192,103 @@ set_multiplicity = INT[2] :\n\
 [1] 16\n\
 paired_coincidence = INT[16] :\n\
 [0] 255\n\
-[0] 255\n\
-[0] 255\n\
-[0] 255\n\
-[0] 255\n\
-[0] 255\n\
-[0] 255\n\
-[0] 255\n\
-[0] 255\n\
-[0] 255\n\
-[0] 255\n\
-[0] 255\n\
-[0] 255\n\
-[0] 255\n\
-[0] 255\n\
-[0] 255\n\
+[1] 255\n\
+[2] 255\n\
+[3] 255\n\
+[4] 255\n\
+[5] 255\n\
+[6] 255\n\
+[7] 255\n\
+[8] 255\n\
+[9] 255\n\
+[10] 255\n\
+[11] 255\n\
+[12] 255\n\
+[13] 255\n\
+[14] 255\n\
+[15] 255\n\
+Coalesce ms = INT : 200\n\
+Max Apply Delay ms = INT : 1000\n\
+Config Cache = STRING : [256] mcfd16.cache\n\
+Alarm Low Hz = FLOAT[20] :\n\
+[0] 0\n\
+[1] 0\n\
+[2] 0\n\
+[3] 0\n\
+[4] 0\n\
+[5] 0\n\
+[6] 0\n\
+[7] 0\n\
+[8] 0\n\
+[9] 0\n\
+[10] 0\n\
+[11] 0\n\
+[12] 0\n\
+[13] 0\n\
+[14] 0\n\
+[15] 0\n\
+[16] 0\n\
+[17] 0\n\
+[18] 0\n\
+[19] 0\n\
+Alarm High Hz = FLOAT[20] :\n\
+[0] 0\n\
+[1] 0\n\
+[2] 0\n\
+[3] 0\n\
+[4] 0\n\
+[5] 0\n\
+[6] 0\n\
+[7] 0\n\
+[8] 0\n\
+[9] 0\n\
+[10] 0\n\
+[11] 0\n\
+[12] 0\n\
+[13] 0\n\
+[14] 0\n\
+[15] 0\n\
+[16] 0\n\
+[17] 0\n\
+[18] 0\n\
+[19] 0\n\
+Alarm Max RSD = FLOAT[20] :\n\
+[0] 0\n\
+[1] 0\n\
+[2] 0\n\
+[3] 0\n\
+[4] 0\n\
+[5] 0\n\
+[6] 0\n\
+[7] 0\n\
+[8] 0\n\
+[9] 0\n\
+[10] 0\n\
+[11] 0\n\
+[12] 0\n\
+[13] 0\n\
+[14] 0\n\
+[15] 0\n\
+[16] 0\n\
+[17] 0\n\
+[18] 0\n\
+[19] 0\n\
+Alarm Hysteresis = FLOAT : 0.1\n\
+Alarm Hold-off ms = INT : 10000\n\
+Find Thresholds = BOOL : n\n\
+Threshold Target Hz = FLOAT : 1000\n\
+Threshold Settle ms = INT : 500\n\
+Run Scan = BOOL : n\n\
+Scan = STRING : [256] set_fraction all 20:60:10\n\
+Scan Dwell ms = INT : 1000\n\
+Scan File = STRING : [256] mcfd_scan.dat\n\
+Config Chunk = INT : 16\n\
+Timeout Floor ms = INT : 20\n\
+Timeout Ceiling ms = INT : 1000\n\
+Auto Baud = BOOL : y\n\
+Max Baud = INT : 0\n\
+History File = STRING : [256] %s.history\n\
+History Records = INT : 1000000\n\
 "
 
 
@@ -173,7 +301,7 @@ typedef struct {
   int gate_selector; // gate selector
   int gate_timing; // Gate allowed timing, hard coding to falling edge right now b/c  of our equipment
   int pulser; // test pulser status
-  int readPeriod_ms; // maybe need?
+  float readPeriod_ms; // minimum age of the rate snapshot before the next sweep, FLOAT in the ODB
   
   int set_polarity[8]; // pair
   int set_gain[8]; // pair
@@ -187,295 +315,801 @@ typedef struct {
   int trigger_pattern[2]; // 2 values
   int set_multiplicity[2]; // Upper & lower
   int paired_coincidence[16]; // 1->15
+  int coalesce_ms; // quiet time after the last edit before the changes are written, 0 writes at once
+  int max_apply_delay_ms; // changes are written at the latest this long after the first edit
+  char config_cache[256]; // file with the last applied configuration, empty to always configure at startup
+  float alarm_low[MCFD_NUM_RATES]; // Hz, alarm below this (dead channel), 0 = off
+  float alarm_high[MCFD_NUM_RATES]; // Hz, alarm above this (hot channel), 0 = off
+  float alarm_max_rsd[MCFD_NUM_RATES]; // alarm when the rolling sd / mean exceeds this (noisy channel), 0 = off
+  float alarm_hysteresis; // fraction of a limit the rate has to move back inside before the alarm clears
+  int alarm_holdoff_ms; // a condition has to persist this long before the alarm state changes
+  BOOL find_thresholds; // set to run the threshold finder once, cleared when it is done
+  float threshold_target_hz; // the finder looks for the lowest threshold with an input rate below this
+  int threshold_settle_ms; // wait after writing thresholds before the rates are read
+  BOOL run_scan; // set to start the scan below, clear to abort it; cleared when it is done
+  char scan[256]; // scan description, see mcfd_scan.h
+  int scan_dwell_ms; // time at each point before its rates are read
+  char scan_file[256]; // binary output, see mcfd_scan.h
+  int config_chunk; // settings writes between two chances for the rate sweep, see mcfd_schedule()
+  int timeout_floor_ms; // learned reply deadlines stay between these two, see mcfd_rtt.h
+  int timeout_ceiling_ms;
+  BOOL auto_baud; // serial only: look for the module's line rate if it does not answer at Baud
+  int max_baud; // serial only: switch the module and the port up to this rate at startup, 0 to stay
+  char history_file[256]; // every sweep at full resolution, see mcfd_history.h; %s is the device name, empty to turn off
+  int history_records; // size of its ring, the file is laid out anew when this changes
   
 //   bool manual_control; // maybe...
 } DD_MCFD_SETTINGS;
 
 
+typedef struct {
+  int depth;                   // commands waiting
+  DWORD served;                // commands sent
+  MCFD_STATS wait;             // ms from queued to sent, over the last MCFD_STAT_WINDOW of them
+} MCFD_LANE;
+
+
+typedef struct {
+  bool active;
+  int lo[MCFD_INPUTS], hi[MCFD_INPUTS]; // threshold interval of each input still searched
+  int missed[MCFD_INPUTS];     // rate reads it missed
+  bool acked[MCFD_INPUTS];     // its probe of this step was acknowledged
+  bool settling;               // probes written, their rates not read yet
+  int steps;
+  DWORD start;                 // ss_millitime() when the search began
+  DWORD written;               // ss_millitime() when the probes of this step went out
+} MCFD_FINDER;
+
+
+typedef struct {
+  bool active;
+  MCFD_SCAN_HEADER header;
+  FILE* file;
+  unsigned point;              // point being dwelt on, the next record
+  DWORD applied;               // ss_millitime() when it was applied
+} MCFD_SCAN;
+
+
 typedef struct {
   DD_MCFD_SETTINGS settings;
   DD_MCFD_SETTINGS settingsIncoming;
 
   INT num_channels;
-  INT(*bd)(INT cmd, ...);      // bus driver entry function
-  void *bd_info;               // private info of bus driver
+  MCFD_TRANSPORT bus;          // rs232, tcpip or a MIDAS bus driver, fixed at compile time
   HNDLE hkey;                  // ODB key for bus driver info
-
-
-  float channel_0_frequency; // 0-15 standard channels 16-18 are trig0,1,2 and 19 is total 
-  float channel_1_frequency;
-  float channel_2_frequency;
-  float channel_3_frequency;
-  float channel_4_frequency;
-  float channel_5_frequency;
-  float channel_6_frequency;
-  float channel_7_frequency;
-  float channel_8_frequency;
-  float channel_9_frequency;
-  float channel_10_frequency;
-  float channel_11_frequency;
-  float channel_12_frequency;
-  float channel_13_frequency;
-  float channel_14_frequency;
-  float channel_15_frequency;
-  float trig_0_frequency;
-  float trig_1_frequency;
-  float trig_2_frequency;
-  float trig_total_frequency;
-  
-  float *array;                // Most recent measurement or NaN, one for each channel
-  DWORD *update_time;          // seconds
-
-  INT get_label_calls;
-
+  char name[NAME_LENGTH];      // of that key, Settings/Devices/<name>; tells modules apart in alarms
+  HNDLE hkeydd;                // ODB key of the DD settings
+  bool settings_open;          // the hot-link on the DD settings is in place
+
+
+  MCFD_CHANNELS ch;            // rates, their statistics and derived quantities
+  DWORD sweep_start;           // ss_millitime() when the last rate sweep started
+  DWORD sweep_end;             // ss_millitime() when it finished
+  DWORD sweep_time;            // ss_time() when the last rate sweep started
+  DWORD sweep_sequence;        // number of sweeps so far
+  DWORD dirty[MCFD_DIRTY_WORDS]; // MCFD_SLOT_* still to be written to the module
+  DD_MCFD_SETTINGS shadow;     // register contents as last read back with ds
+  DWORD shadow_known[MCFD_DIRTY_WORDS]; // MCFD_SLOT_* whose shadow came from the dump
+  unsigned long long dump_hash; // of the last ds reply as received, 0 if there was none
+  int dump_known;              // slots recognised in it, the cache needs all MCFD_NUM_SLOTS
+  unsigned long long identity; // hash of the v reply at startup, the firmware version string
+  DWORD edit_first;            // ss_millitime() of the first edit not yet written, 0 if none
+  DWORD edit_last;             // ss_millitime() of the latest one
+  INT last_get_channel;        // channel of the previous CMD_GET, a smaller one starts a new readout pass
+  INT alarm_state[MCFD_NUM_RATES]; // MCFD_ALARM_* currently raised for each rate
+  INT alarm_pending[MCFD_NUM_RATES]; // state the rate has been asking for since alarm_since
+  DWORD alarm_since[MCFD_NUM_RATES]; // ss_millitime()
+  bool bus_alarm;              // raised after a sweep in which no rate could be read
+  MCFD_SCAN scan;              // parameter scan in progress
+  MCFD_FINDER finder;          // threshold search in progress
+  MCFD_LANE lane[MCFD_NUM_LANES];
+  DWORD queued[MCFD_NUM_SLOTS]; // ss_millitime() when each dirty slot was queued, 0 if it is not
+  bool config_open;            // the coalescing window is over, the config lane is being written
+  int config_written;          // commands it has sent since it opened
+  DWORD config_retry;          // ss_millitime() when the lane reopens for unacknowledged slots, 0 if none
+  int config_backoff;          // ms, the wait before config_retry, 0 after a clean close
+  MCFD_RTT rtt[MCFD_NUM_CLASSES]; // round trips and reply deadline of each command class
+  int base_baud;               // line rate the module answered at on startup, 0 if not serial
+  int bad_sweeps;              // in a row, while above base_baud
+  MCFD_HISTORY history;        // mapped rate history, opened at init
+  unsigned long long sweep_wall_ms; // wall clock ms when the last rate sweep started
 } DD_MCFD_INFO;
 
 
 // Should probably call this every time the fe is started.  This would log PID parameters to the midas.log so they can be recovered later...
 //int recall_pid_settings(bool saveToODB=false); // read from Arduino, print to messages/stdout, optionally save to ODB
 
+// Every MCFD16 reply has the same shape: the echo of the command, zero or more payload
+// lines, then the ``mcfd-16>'' prompt.  frame() stops as soon as the prompt has been
+// received, so a healthy transaction costs only wire time and the deadline is only ever
+// reached when the module fails to answer.  The reply is a view into the receive ring,
+// it has to be used before the next read.
+int mcfd_read_response(DD_MCFD_INFO * info, MCFD_VIEW* reply, int timeout) {
+  int len = info->bus.frame(reply, MCFD_PROMPT, timeout);
+  if (len <= 0)
+    return -1; // no prompt before the deadline
+  return len;
+}
 
-int mcfd_apply_settings(DD_MCFD_INFO* info) {
-  /* Format of most commands to R / W from the MCFD:
-   * (char) + (int) + (opt. modifier) 
-   * Where char is the identifying register, int is the data write and optional modifier is for special cases...
-   */
-  
-  
-  char cmd[256];
-  char str[256];
-  memset(cmd, 0, sizeof(cmd));
-  // want to write for loops to automate the r / w process...
-  
-  for (int i=0; i<16; ++i) { // These are the only commands to write that are 16 wide...
-	snprintf(cmd, sizeof(cmd)-1, "st %d %d\r\n", i, info->settings.set_threshold[i]); // set threshold
-	BD_PUTS(cmd);
-	BD_GETS(str, sizeof(str)-1, "\n", DEFAULT_TIMEOUT); // read echo
-
-	if (i < 3) {
-	  snprintf(cmd, sizeof(cmd)-1, "tr %d %d\r\n", i, info->settings.trigger_source[i]); // set trigger sources
-	  BD_PUTS(cmd);
-	  BD_GETS(str, sizeof(str)-1, "\n", DEFAULT_TIMEOUT); // read echo
-	}
-
-	if (i < 8) {
-	  snprintf(cmd, sizeof(cmd)-1, "sp %d %d\r\n", i, info->settings.set_polarity[i]); // set polarity
-	  BD_PUTS(cmd);
-	  BD_GETS(str, sizeof(str)-1, "\n", DEFAULT_TIMEOUT); // read echo
-	
-	  snprintf(cmd, sizeof(cmd)-1, "sg %d %d\r\n", i, info->settings.set_gain[i]); // set gain
-	  BD_PUTS(cmd);
-	  BD_GETS(str, sizeof(str)-1, "\n", DEFAULT_TIMEOUT); // read echo
-	
-	  snprintf(cmd, sizeof(cmd)-1, "sw %d %d\r\n", i, info->settings.set_width[i]); // set width
-	  BD_PUTS(cmd);
-	  BD_GETS(str, sizeof(str)-1, "\n", DEFAULT_TIMEOUT); // read echo
-	
-	  snprintf(cmd, sizeof(cmd)-1, "sy %d %d\r\n", i, info->settings.set_delay_line[i]); // set delay
-	  BD_PUTS(cmd);
-	  BD_GETS(str, sizeof(str)-1, "\n", DEFAULT_TIMEOUT); // read echo
-	
-	  snprintf(cmd, sizeof(cmd)-1, "sd %d %d\r\n", i, info->settings.set_dead_time[i]); // set dead time
-	  BD_PUTS(cmd);
-	  BD_GETS(str, sizeof(str)-1, "\n", DEFAULT_TIMEOUT); // read echo
-	
-	  snprintf(cmd, sizeof(cmd)-1, "sf %d %d\r\n", i, info->settings.set_fraction[i]); // set fraction
-	  BD_PUTS(cmd);
-	  BD_GETS(str, sizeof(str)-1, "\n", DEFAULT_TIMEOUT); // read echo
-	}
-	if (i < 15) {
-	  snprintf(cmd, sizeof(cmd)-1, "pa %d %d\r\n", (i+1), info->settings.paired_coincidence[i]); // paired_coincidence
-	  BD_PUTS(cmd);
-	  BD_GETS(str, sizeof(str)-1, "\n", DEFAULT_TIMEOUT); // read echo	  
-	}
-  }
-  
-  
-  
-  snprintf(cmd, sizeof(cmd)-1, "tm %d %d\r\n", info->settings.trigger_monitor[0], info->settings.trigger_monitor[1]); // set trigger monitor
-  BD_PUTS(cmd);
-  BD_GETS(str, sizeof(str)-1, "\n", DEFAULT_TIMEOUT); // read echo
-  
-  snprintf(cmd, sizeof(cmd)-1, "sm %d %d\r\n", info->settings.set_multiplicity[0], info->settings.set_multiplicity[1]); // set multiplicity
-  BD_PUTS(cmd);
-  BD_GETS(str, sizeof(str)-1, "\r\n", DEFAULT_TIMEOUT); // read echo
-  
-  snprintf(cmd, sizeof(cmd)-1, "bwl %d\r\n", info->settings.BWL); // set bandwidth limit
-  BD_PUTS(cmd);
-  BD_GETS(str, sizeof(str)-1, "\r\n", DEFAULT_TIMEOUT); // read echo
-  
-  snprintf(cmd, sizeof(cmd)-1, "cfd %d\r\n", info->settings.CFD); // set CFD mode
-  BD_PUTS(cmd);
-  BD_GETS(str, sizeof(str)-1, "\r\n", DEFAULT_TIMEOUT); // read echo
-  
-  snprintf(cmd, sizeof(cmd)-1, "sk %d\r\n", info->settings.set_mask); // set mask registers
-  BD_PUTS(cmd);
-  BD_GETS(str, sizeof(str)-1, "\r\n", DEFAULT_TIMEOUT); // read echo
-  
-  snprintf(cmd, sizeof(cmd)-1, "sc %d\r\n", info->settings.set_coincidence); // set coincidence
-  BD_PUTS(cmd);
-  BD_GETS(str, sizeof(str)-1, "\r\n", DEFAULT_TIMEOUT); // read echo
-  
-  snprintf(cmd, sizeof(cmd)-1, "sv %d\r\n", info->settings.set_veto); // set veto
-  BD_PUTS(cmd);
-  BD_GETS(str, sizeof(str)-1, "\r\n", DEFAULT_TIMEOUT); // read echo
-  
-  snprintf(cmd, sizeof(cmd)-1, "gs %d\r\n", info->settings.gate_selector); // set gate selection
-  BD_PUTS(cmd);
-  BD_GETS(str, sizeof(str)-1, "\r\n", DEFAULT_TIMEOUT); // read echo
-  
-  snprintf(cmd, sizeof(cmd)-1, "ga 1 %d\r\n", info->settings.gate_timing); // set gate timing (NEGATIVE EDGE)
-  BD_PUTS(cmd);
-  BD_GETS(str, sizeof(str)-1, "\r\n", DEFAULT_TIMEOUT); // read echo
-  
-  snprintf(cmd, sizeof(cmd)-1, "p%d\r\n", info->settings.pulser); // set pulser
-  BD_PUTS(cmd);
-  BD_GETS(str, sizeof(str)-1, "\r\n", DEFAULT_TIMEOUT); // read echo
-  
-  
-  return FE_SUCCESS; // TODO: make sure things applied okay...
+inline int mcfd_command_class(const char* cmd) {
+  if (strncmp(cmd, "ra ", 3) == 0)
+    return MCFD_CLASS_RATE;
+  if (strncmp(cmd, "ds", 2) == 0)
+    return MCFD_CLASS_DUMP;
+  return MCFD_CLASS_WRITE;
 }
 
+// Floor and ceiling of every learned deadline from the DD settings, samples are kept
+void mcfd_set_deadlines(DD_MCFD_INFO* info) {
+  int floor = info->settings.timeout_floor_ms > 0 ? info->settings.timeout_floor_ms : 1;
+  int ceiling = info->settings.timeout_ceiling_ms > 0 ? info->settings.timeout_ceiling_ms : DEFAULT_TIMEOUT;
+  for (int c=0; c<MCFD_NUM_CLASSES; ++c) {
+    info->rtt[c].floor = floor;
+    info->rtt[c].ceiling = std::max(floor, ceiling);
+    mcfd_rtt_update(&info->rtt[c]);
+  }
+}
 
-void mcfd_settings_updated(INT hDB, INT hkey, void* vinfo)
-{ // simple routines to iterate through to check for changes in the ODB...
-  printf("Settings updated\n");
+// Send one command and collect its complete reply.  Replies that belong to an earlier,
+// timed-out command are skipped until our own echo shows up or the deadline passes.
+// Without a timeout the command gets the learned deadline of its class, and its round
+// trip or timeout goes back into what is learned.
+int mcfd_transaction(DD_MCFD_INFO * info, const char* cmd, MCFD_VIEW* reply, int timeout=0) {
+  MCFD_RTT* rtt = timeout > 0 ? NULL : &info->rtt[mcfd_command_class(cmd)];
+  if (rtt)
+    timeout = rtt->deadline;
+  int status = info->bus.puts(cmd);
+  if (status < 0) {
+    std::cerr << "puts error." << std::endl;
+    return -1;
+  }
+  
+  DWORD start = ss_millitime();
+  int remaining = timeout;
+  while (remaining > 0) {
+    int len = mcfd_read_response(info, reply, remaining);
+    if (len < 0)
+      break;
+    if (mcfd_echo_matches(reply->data, reply->len, cmd)) {
+      if (rtt)
+        mcfd_rtt_add(rtt, ss_millitime() - start);
+      return len;
+    }
+    remaining = timeout - (int) (ss_millitime() - start); // stale reply, keep reading
+  }
+  if (rtt)
+    mcfd_rtt_timeout(rtt);
+  std::cerr << "Error: no reply from MCFD16 to ``" << std::string(cmd, strcspn(cmd, "\r\n")) << "'' within " << timeout << " ms" << std::endl;
+  return -1;
+}
+
+typedef struct {
+  char cmd[32];                // command line including the trailing \r\n
+  INT status;                  // FE_SUCCESS once its echo and prompt came back
+} MCFD_COMMAND;
+
+// Pipelined submission: keep up to MCFD_PIPELINE_WINDOW commands in flight and match the
+// replies against them in order as they arrive.  The module works through its input one
+// line at a time, so the window only bounds how much sits in its UART buffer.  A reply
+// whose echo belongs to a later command means the ones before it were lost; a timeout
+// fails everything still in flight and the next window is sent.  The round trip of a
+// reply counts from when its command was sent or the reply before it arrived, whichever
+// is later, so commands queued behind each other in the module are not charged for the
+// wait.
+int mcfd_submit_batch(DD_MCFD_INFO* info, MCFD_COMMAND* batch, int n) {
+  MCFD_VIEW reply;
+  MCFD_RTT* rtt = &info->rtt[MCFD_CLASS_WRITE];
+  DWORD sent_at[MCFD_MAX_BATCH], last = 0;
+  int sent=0, done=0, failed=0;
+  
+  while (done < n) {
+    while (sent < n && sent-done < MCFD_PIPELINE_WINDOW) {
+      if (info->bus.puts(batch[sent].cmd) < 0) {
+        std::cerr << "puts error." << std::endl;
+        return FE_ERR_HW;
+      }
+      sent_at[sent++] = ss_millitime();
+    }
+    
+    DWORD from = done > 0 && (int) (last - sent_at[done]) > 0 ? last : sent_at[done];
+    int remaining = rtt->deadline - (int) (ss_millitime() - from);
+    if (mcfd_read_response(info, &reply, std::max(remaining, 1)) < 0) {
+      mcfd_rtt_timeout(rtt);
+      done = sent; // nothing more is coming for this window
+      continue;
+    }
+    
+    for (int i=done; i<sent; ++i) {
+      if (mcfd_echo_matches(reply.data, reply.len, batch[i].cmd)) {
+        last = ss_millitime();
+        mcfd_rtt_add(rtt, last - from);
+        batch[i].status = FE_SUCCESS;
+        done = i+1;
+        break;
+      }
+    } // no match at all: stale reply from an earlier transaction, just drop it
+  }
+  
+  for (int i=0; i<n; ++i) {
+    if (batch[i].status != FE_SUCCESS) {
+      std::cerr << "   ``" << std::string(batch[i].cmd, strcspn(batch[i].cmd, "\r\n")) << "'' was not acknowledged" << std::endl;
+      failed++;
+    }
+  }
+  
+  return failed ? FE_ERR_HW : FE_SUCCESS;
+}
 
-  DD_MCFD_INFO* info = (DD_MCFD_INFO*) vinfo;
 
-  bool changed=false;
+// The command line for one slot, or an empty string if the slot is out of range
+void mcfd_format_slot(const DD_MCFD_SETTINGS* s, int slot, char* cmd, int size) {
+  int i;
+  cmd[0] = 0;
+  if (slot < MCFD_SLOT_TRIGGER_SOURCE)
+    snprintf(cmd, size, "st %d %d\r\n", slot, s->set_threshold[slot]);
+  else if (slot < MCFD_SLOT_POLARITY) {
+    i = slot - MCFD_SLOT_TRIGGER_SOURCE;
+    snprintf(cmd, size, "tr %d %d\r\n", i, s->trigger_source[i]);
+  }
+  else if (slot < MCFD_SLOT_PAIRED_COINCIDENCE) {
+    static const char* name[6] = { "sp", "sg", "sw", "sy", "sd", "sf" };
+    const int* value[6] = { s->set_polarity, s->set_gain, s->set_width, s->set_delay_line, s->set_dead_time, s->set_fraction };
+    int reg = (slot - MCFD_SLOT_POLARITY) / 8;
+    i = (slot - MCFD_SLOT_POLARITY) % 8;
+    snprintf(cmd, size, "%s %d %d\r\n", name[reg], i, value[reg][i]);
+  }
+  else if (slot < MCFD_SLOT_TRIGGER_MONITOR) {
+    i = slot - MCFD_SLOT_PAIRED_COINCIDENCE;
+    snprintf(cmd, size, "pa %d %d\r\n", i+1, s->paired_coincidence[i]);
+  }
+  else switch (slot) {
+    case MCFD_SLOT_TRIGGER_MONITOR: snprintf(cmd, size, "tm %d %d\r\n", s->trigger_monitor[0], s->trigger_monitor[1]); break;
+    case MCFD_SLOT_MULTIPLICITY: snprintf(cmd, size, "sm %d %d\r\n", s->set_multiplicity[0], s->set_multiplicity[1]); break;
+    case MCFD_SLOT_BWL: snprintf(cmd, size, "bwl %d\r\n", s->BWL); break;
+    case MCFD_SLOT_CFD: snprintf(cmd, size, "cfd %d\r\n", s->CFD); break;
+    case MCFD_SLOT_MASK: snprintf(cmd, size, "sk %d\r\n", s->set_mask); break;
+    case MCFD_SLOT_COINCIDENCE: snprintf(cmd, size, "sc %d\r\n", s->set_coincidence); break;
+    case MCFD_SLOT_VETO: snprintf(cmd, size, "sv %d\r\n", s->set_veto); break;
+    case MCFD_SLOT_GATE_SELECTOR: snprintf(cmd, size, "gs %d\r\n", s->gate_selector); break;
+    case MCFD_SLOT_GATE_TIMING: snprintf(cmd, size, "ga 1 %d\r\n", s->gate_timing); break; // NEGATIVE EDGE
+    case MCFD_SLOT_PULSER: snprintf(cmd, size, "p%d\r\n", s->pulser); break;
+  }
+}
 
+inline void mcfd_set_dirty(DWORD* dirty, int slot) { dirty[slot/32] |= 1u << (slot%32); }
+inline void mcfd_clear_dirty(DWORD* dirty, int slot) { dirty[slot/32] &= ~(1u << (slot%32)); }
+inline bool mcfd_is_dirty(const DWORD* dirty, int slot) { return dirty[slot/32] & (1u << (slot%32)); }
+
+// Mark every slot whose command line differs between the two settings.  Comparing the
+// formatted commands keeps the dirty set exactly in step with what apply would send,
+// including tm and sm where either of two values changes the one command.
+int mcfd_diff_settings(const DD_MCFD_SETTINGS* from, const DD_MCFD_SETTINGS* to, DWORD* dirty, bool verbose=true) {
+  char a[32], b[32];
+  int n=0;
+  for (int slot=0; slot<MCFD_NUM_SLOTS; ++slot) {
+    mcfd_format_slot(from, slot, a, sizeof(a));
+    mcfd_format_slot(to, slot, b, sizeof(b));
+    if (strcmp(a, b) != 0) {
+      if (verbose)
+        std::cout << "   ``" << std::string(a, strcspn(a, "\r\n")) << "'' changed to ``" << std::string(b, strcspn(b, "\r\n")) << "''" << std::endl;
+      mcfd_set_dirty(dirty, slot);
+      n++;
+    }
+  }
+  return n;
+}
+
+// An int or int array in DD_MCFD_SETTINGS, by name
+typedef struct {
+  const char* label;
+  size_t offset;               // of the first int in DD_MCFD_SETTINGS
+  int count;
+  int first;                   // values before this one are skipped, ds tables only
+} MCFD_SETTINGS_FIELD;
+
+// Where each group of the ``ds'' dump lands in DD_MCFD_SETTINGS.  Values before first are
+// read but not kept: the dump lists both gate timings, the driver only writes ``ga 1''.
+// Only the Threshold label has been seen in a reply from a module (TEST/rs232.log); a
+// group whose label does not match stays unknown and its registers are written.
+
+static const MCFD_SETTINGS_FIELD mcfd_dump_fields[] = {
+  { "Threshold", offsetof(DD_MCFD_SETTINGS, set_threshold), 16, 0 },
+  { "Polarity", offsetof(DD_MCFD_SETTINGS, set_polarity), 8, 0 },
+  { "Gain", offsetof(DD_MCFD_SETTINGS, set_gain), 8, 0 },
+  { "Width", offsetof(DD_MCFD_SETTINGS, set_width), 8, 0 },
+  { "Delay", offsetof(DD_MCFD_SETTINGS, set_delay_line), 8, 0 },
+  { "Dead time", offsetof(DD_MCFD_SETTINGS, set_dead_time), 8, 0 },
+  { "Fraction", offsetof(DD_MCFD_SETTINGS, set_fraction), 8, 0 },
+  { "Pair coincidence", offsetof(DD_MCFD_SETTINGS, paired_coincidence), 15, 0 },
+  { "Trigger source", offsetof(DD_MCFD_SETTINGS, trigger_source), 3, 0 },
+  { "Trigger monitor", offsetof(DD_MCFD_SETTINGS, trigger_monitor), 2, 0 },
+  { "Multiplicity", offsetof(DD_MCFD_SETTINGS, set_multiplicity), 2, 0 },
+  { "Gate timing", offsetof(DD_MCFD_SETTINGS, gate_timing), 1, 1 },
+  { "Gate select", offsetof(DD_MCFD_SETTINGS, gate_selector), 1, 0 },
+  { "Coincidence", offsetof(DD_MCFD_SETTINGS, set_coincidence), 1, 0 },
+  { "Mask", offsetof(DD_MCFD_SETTINGS, set_mask), 1, 0 },
+  { "Veto", offsetof(DD_MCFD_SETTINGS, set_veto), 1, 0 },
+  { "BWL", offsetof(DD_MCFD_SETTINGS, BWL), 1, 0 },
+  { "CFD", offsetof(DD_MCFD_SETTINGS, CFD), 1, 0 },
+  { "Pulser", offsetof(DD_MCFD_SETTINGS, pulser), 1, 0 },
+};
+
+// A group is only taken whole: one with more or fewer values than its registers (bytes
+// lost on the line, a continuation line missing) leaves all of them untouched
+void mcfd_fill_from_dump(DD_MCFD_SETTINGS* s, const char* reply, int len) {
+  int values[16];
+  for (size_t f=0; f<sizeof(mcfd_dump_fields)/sizeof(mcfd_dump_fields[0]); ++f) {
+    const MCFD_SETTINGS_FIELD* field = &mcfd_dump_fields[f];
+    int n = mcfd_parse_dump_group(reply, len, field->label, values, field->first + field->count);
+    if (n != field->first + field->count)
+      continue;
+    int* dest = (int*) ((char*) s + field->offset);
+    for (int i=0; i<field->count; ++i)
+      dest[i] = values[i+field->first];
+  }
+}
+
+// Refresh the shadow with one ``ds'' transaction.  Registers missing from the dump (older
+// firmware, a garbled line) are found by parsing it over two different backgrounds: a slot
+// is only known if its command line comes out the same from both.  Returns the number of
+// known slots, 0 if there was no dump.
+int mcfd_read_shadow(DD_MCFD_INFO* info) {
+  MCFD_VIEW reply;
+  DD_MCFD_SETTINGS other;
+  char a[32], b[32];
+  int known=0;
+  
+  memset(info->shadow_known, 0, sizeof(info->shadow_known));
+  info->dump_hash = 0;
+  info->dump_known = 0;
+  if (mcfd_transaction(info, "ds\r\n", &reply) <= 0)
+    return 0;
+  info->dump_hash = mcfd_hash(reply.data, reply.len);
   
-  if (info->settingsIncoming.BWL != info->settings.BWL) {
-    std::cout << "   BWL changed from ``" << info->settings.BWL << "'' to ``" << info->settingsIncoming.BWL << "''" << std::endl;
-    info->settings.BWL = info->settingsIncoming.BWL;
-    //cm_msg(MINFO, "pid_settings_updated", "This frontend must be restarted for changes to     ``kP'' to take effect.");
-    changed=true;
+  memset(&info->shadow, 0, sizeof(info->shadow));
+  memset(&other, 0xff, sizeof(other));
+  mcfd_fill_from_dump(&info->shadow, reply.data, reply.len);
+  mcfd_fill_from_dump(&other, reply.data, reply.len);
+  for (int slot=0; slot<MCFD_NUM_SLOTS; ++slot) {
+    mcfd_format_slot(&info->shadow, slot, a, sizeof(a));
+    mcfd_format_slot(&other, slot, b, sizeof(b));
+    if (strcmp(a, b) == 0) {
+      mcfd_set_dirty(info->shadow_known, slot);
+      known++;
+    }
   }
+  info->dump_known = known;
+  return known;
+}
+
+// Compare the settings against a fresh dump, one line per register that reads back
+// different from what was written.  Slots still waiting for a write are left out.
+// Returns the number of mismatches, -1 if the module sent no dump.
+int mcfd_verify_settings(DD_MCFD_INFO* info) {
+  char want[32], have[32];
+  int mismatched=0;
   
-  if (info->settingsIncoming.CFD != info->settings.CFD) {
-    std::cout << "   CFD changed from ``" << info->settings.CFD << "'' to ``" << info->settingsIncoming.CFD << "''" << std::endl;
-    info->settings.CFD = info->settingsIncoming.CFD;
-    changed=true;
+  if (mcfd_read_shadow(info) == 0) {
+    if (info->dump_hash == 0) {
+      std::cerr << "Error: no settings dump from MCFD16, applied settings not verified" << std::endl;
+      return -1;
+    }
+    std::cerr << "Settings dump not understood, applied settings not verified" << std::endl;
+    return 0;
   }
+  for (int slot=0; slot<MCFD_NUM_SLOTS; ++slot) {
+    if (!mcfd_is_dirty(info->shadow_known, slot) || mcfd_is_dirty(info->dirty, slot))
+      continue;
+    mcfd_format_slot(&info->settings, slot, want, sizeof(want));
+    mcfd_format_slot(&info->shadow, slot, have, sizeof(have));
+    if (strcmp(want, have) != 0) {
+      std::cerr << "Error: ``" << std::string(want, strcspn(want, "\r\n")) << "'' reads back as ``" << std::string(have, strcspn(have, "\r\n")) << "''" << std::endl;
+      mismatched++;
+    }
+  }
+  return mismatched;
+}
 
-  if (info->settingsIncoming.set_mask != info->settings.set_mask) {
-    std::cout << "   set_mask changed from ``" << info->settings.set_mask << "'' to ``" << info->settingsIncoming.set_mask << "''" << std::endl;
-    info->settings.set_mask = info->settingsIncoming.set_mask;
-    changed=true;
+
+// The configuration cache: what was applied last and what the module looked like after
+// it, so a restarted frontend can tell from two short transactions that the module has
+// the same contents and needs nothing written.  The dump is compared as received, but
+// only a dump that read back every slot counts: one that lost bytes or that the module
+// rejects can be the same before and after a power cycle while the registers are not.
+// The identity is only the hash of the version string, every module with the same
+// firmware has the same one.
+#define MCFD_CACHE_MAGIC 0x4346434d   // ``MCFC''
+
+typedef struct {
+  DWORD magic;
+  DWORD size;                  // sizeof(MCFD_CONFIG_CACHE), anything else is from another build
+  DWORD time;                  // ss_time() of the apply
+  unsigned long long identity; // hash of the v reply, the firmware, not the unit
+  unsigned long long settings_hash; // mcfd_settings_hash() of what was applied
+  unsigned long long dump_hash; // hash of the ds reply after the apply
+  DD_MCFD_SETTINGS settings;
+} MCFD_CONFIG_CACHE;
+
+// Every command line apply would send, so fields without a command do not count
+unsigned long long mcfd_settings_hash(const DD_MCFD_SETTINGS* s) {
+  char cmd[32];
+  unsigned long long h = mcfd_hash("", 0);
+  for (int slot=0; slot<MCFD_NUM_SLOTS; ++slot) {
+    mcfd_format_slot(s, slot, cmd, sizeof(cmd));
+    h = mcfd_hash(cmd, strlen(cmd), h);
   }
+  return h;
+}
 
-  if (info->settingsIncoming.set_coincidence != info->settings.set_coincidence) {
-    std::cout << "   set_coincidence changed from ``" << info->settings.set_coincidence << "'' to ``" << info->settingsIncoming.set_coincidence << "''" << std::endl;
-    info->settings.set_coincidence = info->settingsIncoming.set_coincidence;
-    changed=true;
+// Written to a temporary file and renamed, a crash never leaves half a cache behind
+void mcfd_save_config(DD_MCFD_INFO* info) {
+  const char* file = info->settings.config_cache;
+  if (file[0] == 0 || info->dump_hash == 0 || info->dump_known != MCFD_NUM_SLOTS)
+    return;
+  
+  MCFD_CONFIG_CACHE cache;
+  memset(&cache, 0, sizeof(cache));
+  cache.magic = MCFD_CACHE_MAGIC;
+  cache.size = sizeof(cache);
+  cache.time = ss_time();
+  cache.identity = info->identity;
+  cache.settings_hash = mcfd_settings_hash(&info->settings);
+  cache.dump_hash = info->dump_hash;
+  cache.settings = info->settings;
+  
+  std::string tmp = std::string(file) + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "wb");
+  if (f == NULL) {
+    cm_msg(MERROR, "mcfd_save_config", "Cannot write configuration cache \"%s\"", tmp.c_str());
+    return;
   }
+  bool ok = fwrite(&cache, sizeof(cache), 1, f) == 1;
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), file) != 0)
+    cm_msg(MERROR, "mcfd_save_config", "Cannot write configuration cache \"%s\"", file);
+}
 
-  if (info->settingsIncoming.set_veto != info->settings.set_veto) {
-    std::cout << "   set_veto changed from ``" << info->settings.set_veto << "'' to ``" << info->settingsIncoming.set_veto << "''" << std::endl;
-    info->settings.set_veto = info->settingsIncoming.set_veto;
-    changed=true;
+// True if the cache says the module already holds the settings: same firmware, the ODB
+// unchanged since the apply, and a dump that read back every slot and is identical to
+// the one taken after it.  The shadow is then taken from the cache, every register
+// counts as known.  Anything less and the module is configured in full.
+bool mcfd_config_unchanged(DD_MCFD_INFO* info) {
+  const char* file = info->settings.config_cache;
+  MCFD_CONFIG_CACHE cache;
+  if (file[0] == 0 || info->dump_hash == 0 || info->dump_known != MCFD_NUM_SLOTS)
+    return false;
+  
+  FILE* f = fopen(file, "rb");
+  if (f == NULL)
+    return false;
+  bool ok = fread(&cache, sizeof(cache), 1, f) == 1;
+  fclose(f);
+  if (!ok || cache.magic != MCFD_CACHE_MAGIC || cache.size != sizeof(cache))
+    return false;
+  
+  if (cache.identity != info->identity) {
+    printf("Configuration cache is for different firmware\n");
+    return false;
+  }
+  if (cache.settings_hash != mcfd_settings_hash(&info->settings)) {
+    printf("Settings changed since the last apply\n");
+    return false;
+  }
+  if (cache.dump_hash != info->dump_hash) {
+    printf("MCFD16 registers changed since the last apply (power cycle or front panel)\n");
+    return false;
   }
   
-  if (info->settingsIncoming.readPeriod_ms != info->settings.readPeriod_ms) {
-    std::cout << "   readPeriod_ms changed from ``" << info->settings.readPeriod_ms << "'' to ``" << info->settingsIncoming.readPeriod_ms << "''" << std::endl;
-    info->settings.readPeriod_ms = info->settingsIncoming.readPeriod_ms;
-    changed=true;
+  info->shadow = cache.settings;
+  for (int slot=0; slot<MCFD_NUM_SLOTS; ++slot)
+    mcfd_set_dirty(info->shadow_known, slot);
+  time_t applied = cache.time;
+  printf("MCFD16 unchanged since the apply of %s", ctime(&applied));
+  return true;
+}
+
+inline int mcfd_slot_lane(int slot) {
+  return slot == MCFD_SLOT_VETO || slot == MCFD_SLOT_PULSER ? MCFD_LANE_CONTROL : MCFD_LANE_CONFIG;
+}
+
+inline void mcfd_lane_served(MCFD_LANE* lane, DWORD wait_ms) {
+  lane->served++;
+  mcfd_stats_add(&lane->wait, wait_ms);
+}
+
+// Stamp newly dirty slots with the time they were queued and count what waits in each lane
+void mcfd_queue_dirty(DD_MCFD_INFO* info) {
+  DWORD now = ss_millitime();
+  info->lane[MCFD_LANE_CONTROL].depth = info->lane[MCFD_LANE_CONFIG].depth = 0;
+  for (int slot=0; slot<MCFD_NUM_SLOTS; ++slot) {
+    if (!mcfd_is_dirty(info->dirty, slot))
+      continue;
+    if (info->queued[slot] == 0)
+      info->queued[slot] = now;
+    info->lane[mcfd_slot_lane(slot)].depth++;
   }
+}
 
-  if (info->settingsIncoming.gate_selector != info->settings.gate_selector) {
-    std::cout << "   gate_selector changed from ``" << info->settings.gate_selector << "'' to ``" << info->settingsIncoming.gate_selector << "''" << std::endl;
-    info->settings.gate_selector = info->settingsIncoming.gate_selector;
-    changed=true;    
+// Write up to max dirty slots of one lane, or of every lane if lane is -1, and skip those
+// the shadow says already hold the value.  A command the module did not acknowledge stays
+// dirty and goes out again later.  What was written drops out of the shadow until the
+// next dump.  *written counts the commands sent.
+int mcfd_write_dirty(DD_MCFD_INFO* info, int lane, int max, int* written) {
+  MCFD_COMMAND batch[MCFD_MAX_BATCH];
+  int slots[MCFD_MAX_BATCH];
+  char current[32];
+  int n=0, skipped=0;
+  
+  mcfd_queue_dirty(info);
+  for (int slot=0; slot<MCFD_NUM_SLOTS && n<max && n<MCFD_MAX_BATCH; ++slot) {
+    if (!mcfd_is_dirty(info->dirty, slot) || (lane >= 0 && mcfd_slot_lane(slot) != lane))
+      continue;
+    mcfd_format_slot(&info->settings, slot, batch[n].cmd, sizeof(batch[n].cmd));
+    if (mcfd_is_dirty(info->shadow_known, slot)) {
+      mcfd_format_slot(&info->shadow, slot, current, sizeof(current));
+      if (strcmp(current, batch[n].cmd) == 0) {
+        mcfd_clear_dirty(info->dirty, slot);
+        info->queued[slot] = 0;
+        skipped++;
+        continue;
+      }
+    }
+    batch[n].status = FE_ERR_HW;
+    slots[n++] = slot;
+  }
+  if (skipped)
+    printf("%d register(s) already set, %d to write\n", skipped, n);
+  *written = n;
+  if (n == 0) {
+    mcfd_queue_dirty(info);
+    return FE_SUCCESS;
   }
   
-  if (info->settingsIncoming.gate_timing != info->settings.gate_timing) {
-    std::cout << "   gate_timing changed from ``" << info->settings.gate_timing << "'' to ``" << info->settingsIncoming.gate_timing << "''" << std::endl;
-    info->settings.gate_timing = info->settingsIncoming.gate_timing;
-    changed=true;
+  DWORD now = ss_millitime();
+  for (int i=0; i<n; ++i)
+    mcfd_lane_served(&info->lane[mcfd_slot_lane(slots[i])], now - info->queued[slots[i]]);
+  int status = mcfd_submit_batch(info, batch, n);
+  for (int i=0; i<n; ++i) {
+    mcfd_clear_dirty(info->shadow_known, slots[i]);
+    if (batch[i].status == FE_SUCCESS) {
+      mcfd_clear_dirty(info->dirty, slots[i]);
+      info->queued[slots[i]] = 0;
+    }
+  }
+  mcfd_queue_dirty(info);
+  return status;
+}
+
+// Write every dirty slot at once.  Whatever was written is checked with one readback of
+// the dump and recorded in the configuration cache; scan points skip both.
+int mcfd_apply_dirty(DD_MCFD_INFO* info, bool verify=true) {
+  int written;
+  int status = mcfd_write_dirty(info, -1, MCFD_MAX_BATCH, &written);
+  if (!verify)
+    return status;
+  if (written > 0 && mcfd_verify_settings(info) != 0)
+    status = FE_ERR_HW;
+  if (status == FE_SUCCESS)
+    mcfd_save_config(info); // everything acknowledged and nothing read back wrong
+  return status;
+}
+
+// Full reconfiguration, at startup
+int mcfd_apply_settings(DD_MCFD_INFO* info) {
+  for (int slot=0; slot<MCFD_NUM_SLOTS; ++slot)
+    mcfd_set_dirty(info->dirty, slot);
+  return mcfd_apply_dirty(info);
+}
+
+
+// Open the config lane for the edits collected by mcfd_settings_updated once the ODB has
+// been quiet for Coalesce ms, or Max Apply Delay ms after the first of them if the edits
+// keep coming.  Called from every CMD_GET, so a burst such as an odbedit load becomes one
+// apply.  force writes everything still queued at once, at exit.
+void mcfd_flush_settings(DD_MCFD_INFO* info, bool force=false) {
+  if (info->edit_first != 0) {
+    DWORD now = ss_millitime();
+    if (!force &&
+        (int) (now - info->edit_last) < info->settings.coalesce_ms &&
+        (int) (now - info->edit_first) < info->settings.max_apply_delay_ms)
+      return;
+    info->edit_first = 0;
+    if (!info->config_open)
+      info->config_written = 0;
+    info->config_open = true;
+  }
+  if (force && info->config_open) {
+    info->config_open = false;
+    mcfd_apply_dirty(info);
+  }
+}
+
+void mcfd_settings_updated(INT hDB, INT hkey, void* vinfo)
+{ // only the registers that changed are written, one round trip each
+  printf("Settings updated\n");
+
+  DD_MCFD_INFO* info = (DD_MCFD_INFO*) vinfo;
+  // Veto and pulser go out at once, also while a scan or the threshold finder holds the
+  // other registers back
+  DD_MCFD_SETTINGS* s = &info->settings;
+  const DD_MCFD_SETTINGS* in = &info->settingsIncoming;
+  if (in->set_veto != s->set_veto || in->pulser != s->pulser) {
+    DD_MCFD_SETTINGS before = *s;
+    s->set_veto = in->set_veto;
+    s->pulser = in->pulser;
+    mcfd_diff_settings(&before, s, info->dirty);
+    int written;
+    mcfd_write_dirty(info, MCFD_LANE_CONTROL, MCFD_MAX_BATCH, &written); // ahead of any apply still in progress
   }
   
-  if (info->settingsIncoming.pulser != info->settings.pulser) {
-    std::cout << "   pulser changed from ``" << info->settings.pulser << "'' to ``" << info->settingsIncoming.pulser << "''" << std::endl;
-    info->settings.pulser = info->settingsIncoming.pulser;
-    changed=true;
+  if (info->scan.active || info->finder.active) {
+    printf("   other edits deferred until the %s ends\n", info->scan.active ? "scan" : "threshold search"); // the module holds scan points or probes
+    return;
   }
+
+  if (info->settingsIncoming.readPeriod_ms != info->settings.readPeriod_ms)
+    std::cout << "   readPeriod_ms changed from ``" << info->settings.readPeriod_ms << "'' to ``" << info->settingsIncoming.readPeriod_ms << "''" << std::endl;
   
-  for (int i=0; i<16; ++i) {
-    if (i < 2) {  
-      
-      if (info->settingsIncoming.set_multiplicity[i] != info->settings.set_multiplicity[i]) {
-	  std::cout << "   set_multiplicity[" << i << "]  changed from ``" << info->settings.set_multiplicity[i] << "'' to ``" << info->settingsIncoming.set_multiplicity[i] << "''" << std::endl;
-	  info->settings.set_multiplicity[0] = info->settingsIncoming.set_multiplicity[i];
-	  changed=true;
-      }
-      
-      if (info->settingsIncoming.trigger_monitor[i] != info->settings.trigger_monitor[i]) {
-	  std::cout << "   trigger_monitor[" << i << "] changed from ``" << info->settings.trigger_monitor[i] << "'' to ``" << info->settingsIncoming.trigger_monitor[i] << "''" << std::endl;
-	  info->settings.trigger_monitor[i] = info->settingsIncoming.trigger_monitor[i];
-	  changed=true;
-      }
-      
-      if (info->settingsIncoming.trigger_pattern[i] != info->settings.trigger_pattern[i]) {
-	  std::cout << "   trigger_pattern[" << i << "] changed from ``" << info->settings.trigger_pattern[i] << "'' to ``" << info->settingsIncoming.trigger_pattern[i] << "''" << std::endl;
-	  info->settings.trigger_pattern[i] = info->settingsIncoming.trigger_pattern[i];
-	  changed=true;
+  int changed = mcfd_diff_settings(&info->settings, &info->settingsIncoming, info->dirty);
+  memcpy(&info->settings, &info->settingsIncoming, sizeof(info->settingsIncoming)); // also takes readPeriod_ms and trigger_pattern, which have no command
+  mcfd_set_dead_time(&info->ch, info->settings.set_dead_time, info->settings.set_width);
+  mcfd_set_deadlines(info);
+  
+  if (changed) {
+    mcfd_queue_dirty(info);
+    if (info->lane[MCFD_LANE_CONFIG].depth == 0)
+      return;
+    info->edit_last = ss_millitime();
+    if (info->edit_first == 0)
+      info->edit_first = info->edit_last;
+    mcfd_flush_settings(info); // mcfd_schedule starts on it at once if Coalesce ms is 0
+  }
+}
+
+
+// Line rates the module can be switched to with ``br <code>'', code = index + 1
+static const int mcfd_baud_rates[] = { 9600, 19200, 38400, 57600, 115200 };
+#define MCFD_NUM_BAUD_RATES (int) (sizeof(mcfd_baud_rates)/sizeof(mcfd_baud_rates[0]))
+
+// An empty line is answered with the bare prompt
+bool mcfd_probe_prompt(DD_MCFD_INFO* info, int timeout) {
+  MCFD_VIEW reply;
+  return info->bus.puts("\r\n") >= 0 && mcfd_read_response(info, &reply, timeout) >= 0;
+}
+
+// Try the port at every rate the module knows until the prompt comes back, at most until
+// deadline.  At the wrong rate the module only sees framing errors and we only garbage,
+// neither ever looks like a prompt.  Each rate gets a second probe and the one the port
+// was at a third, so a single lost byte does not hide the module.  The port is left at
+// the rate that worked, or where it was.
+bool mcfd_detect_baud(DD_MCFD_INFO* info, DWORD deadline) {
+  int tried = info->bus.line_rate();
+  for (int k=0; k<=MCFD_NUM_BAUD_RATES && (int) (deadline - ss_millitime()) > 0; ++k) {
+    int baud = k < MCFD_NUM_BAUD_RATES ? mcfd_baud_rates[k] : tried;
+    if (baud == tried && k < MCFD_NUM_BAUD_RATES)
+      continue;
+    if (info->bus.set_baud(baud) != SUCCESS)
+      return false;
+    for (int probe=0; probe<2; ++probe) {
+      info->bus.flush(MCFD_FLUSH_QUIET, MCFD_BAUD_PROBE);
+      if (mcfd_probe_prompt(info, MCFD_BAUD_PROBE)) {
+        if (baud != tried)
+          cm_msg(MINFO, "mcfd_detect_baud", "MCFD16 answers at %d baud, not at %d", baud, tried);
+        return true;
       }
     }
-    
-    if (i < 8) {
-      if (info->settingsIncoming.set_polarity[i] != info->settings.set_polarity[i]) {
-	  std::cout << "   set_polarity[" << i << "] changed from ``" << info->settings.set_polarity[i] << "'' to ``" << info->settingsIncoming.set_polarity[i] << "''" << std::endl;
-	  info->settings.set_polarity[i] = info->settingsIncoming.set_polarity[i];
-	  changed=true;
-      }
-      
-      if (info->settingsIncoming.set_gain[i] != info->settings.set_gain[i]) {
-	  std::cout << "   set_gain[" << i << "] changed from ``" << info->settings.set_gain[i] << "'' to ``" << info->settingsIncoming.set_gain[i] << "''" << std::endl;
-	  info->settings.set_gain[i] = info->settingsIncoming.set_gain[i];
-	  changed=true;
-      }
-      
-      if (info->settingsIncoming.set_width[i] != info->settings.set_width[i]) {
-	  std::cout << "   set_width[" << i << "] changed from ``" << info->settings.set_width[i] << "'' to ``" << info->settingsIncoming.set_width[i] << "''" << std::endl;
-	  info->settings.set_width[i] = info->settingsIncoming.set_width[i];
-	  changed=true;
-      }
-      
-      if (info->settingsIncoming.set_dead_time[i] != info->settings.set_dead_time[i]) {
-	  std::cout << "   set_dead_time[" << i << "] changed from ``" << info->settings.set_dead_time[i] << "'' to ``" << info->settingsIncoming.set_dead_time[i] << "''" << std::endl;
-	  info->settings.set_dead_time[i] = info->settingsIncoming.set_dead_time[i];
-	  changed=true;
-      }
-      
-      if (info->settingsIncoming.set_delay_line[i] != info->settings.set_delay_line[i]) {
-	  std::cout << "   set_delay_line[" << i << "] changed from ``" << info->settings.set_delay_line[i] << "'' to ``" << info->settingsIncoming.set_delay_line[i] << "''" << std::endl;
-	  info->settings.set_delay_line[i] = info->settingsIncoming.set_delay_line[i];
-	  changed=true;
-      }
-      
-      if (info->settingsIncoming.set_fraction[i] != info->settings.set_fraction[i]) {
-	  std::cout << "   set_fraction[" << i << "] changed from ``" << info->settings.set_fraction[i] << "'' to ``" << info->settingsIncoming.set_fraction[i] << "''" << std::endl;
-	  info->settings.set_fraction[i] = info->settingsIncoming.set_fraction[i];
-	  changed=true;
-      }
-      
+  }
+  info->bus.set_baud(tried);
+  return false;
+}
+
+// Tell the module its new rate with ``br'', answered at the old rate, then follow with the
+// port.  If the prompt does not come back at the new rate the module is looked for at all
+// of them.  Learned deadlines start over, round trips scale with the rate.
+int mcfd_switch_baud(DD_MCFD_INFO* info, int baud) {
+  MCFD_VIEW reply;
+  char cmd[16];
+  int old = info->bus.line_rate(), code = 0;
+  for (int k=0; k<MCFD_NUM_BAUD_RATES; ++k)
+    if (mcfd_baud_rates[k] == baud)
+      code = k+1;
+  if (code == 0 || old == 0)
+    return FE_ERR_DRIVER;
+  
+  snprintf(cmd, sizeof(cmd), "br %d\r\n", code);
+  if (mcfd_transaction(info, cmd, &reply, DEFAULT_TIMEOUT) <= 0 || info->bus.set_baud(baud) != SUCCESS ||
+      !mcfd_probe_prompt(info, MCFD_BAUD_PROBE)) {
+    if (!mcfd_detect_baud(info, ss_millitime() + MCFD_STARTUP_BUDGET)) {
+      cm_msg(MERROR, "mcfd_switch_baud", "MCFD16 lost while switching from %d to %d baud", old, baud);
+      return FE_ERR_HW;
     }
-    
-    if (info->settingsIncoming.set_threshold[i] != info->settings.set_threshold[i]) {
-	  std::cout << "   set_threshold[" << i << "] changed from ``" << info->settings.set_threshold[i] << "'' to ``" << info->settingsIncoming.set_threshold[i] << "''" << std::endl;
-	  info->settings.set_threshold[i] = info->settingsIncoming.set_threshold[i];
-	  changed=true;
-      }
-      
-    if (info->settingsIncoming.paired_coincidence[i] != info->settings.paired_coincidence[i]) {
-	  std::cout << "   paired_coincidence[" << i << "] changed from ``" << info->settings.paired_coincidence[i] << "'' to ``" << info->settingsIncoming.paired_coincidence[i] << "''" << std::endl;
-	  info->settings.paired_coincidence[i] = info->settingsIncoming.paired_coincidence[i];
-	  changed=true;
-      }
   }
+  for (int c=0; c<MCFD_NUM_CLASSES; ++c)
+    mcfd_rtt_reset(&info->rtt[c], 1, DEFAULT_TIMEOUT);
+  mcfd_set_deadlines(info);
+  info->bad_sweeps = 0;
+  cm_msg(MINFO, "mcfd_switch_baud", "MCFD16 line rate %d baud, was %d", info->bus.line_rate(), old);
+  return info->bus.line_rate() == baud ? FE_SUCCESS : FE_ERR_HW;
+}
+
+// Fastest rate of the module up to max_baud, 0 if there is none
+int mcfd_fastest_baud(int max_baud) {
+  int baud = 0;
+  for (int k=0; k<MCFD_NUM_BAUD_RATES; ++k)
+    if (mcfd_baud_rates[k] <= max_baud)
+      baud = mcfd_baud_rates[k];
+  return baud;
+}
+
+// Startup handshake, every phase bounded by what is left of MCFD_STARTUP_BUDGET:
+//   flush     drop whatever the module or the port still holds from before
+//   prompt    an empty line, answered by the bare prompt; with Auto Baud set it is only
+//             given MCFD_BAUD_PROBE, then every other line rate is tried
+//   identity  ``v'', which has to name an MCFD-16; its hash identifies the firmware, not
+//             the unit
+// FE_ERR_HW as soon as the module fails to answer, the identity only warns.
+int mcfd_handshake(DD_MCFD_INFO* info) {
+  MCFD_VIEW reply;
+  DWORD start = ss_millitime();
+  DWORD phase = start;
+  int t_flush, t_prompt, t_identity;
+  
+  int dropped = info->bus.flush(MCFD_FLUSH_QUIET, MCFD_STARTUP_BUDGET/4);
+  t_flush = ss_millitime() - phase;
+  phase = ss_millitime();
+  
+  int remaining = MCFD_STARTUP_BUDGET - (int) (phase - start);
+  bool detect = info->settings.auto_baud && info->bus.line_rate() > 0;
+  if (!mcfd_probe_prompt(info, min(detect ? MCFD_BAUD_PROBE : DEFAULT_TIMEOUT, remaining)) &&
+      !(detect && mcfd_detect_baud(info, start + MCFD_STARTUP_BUDGET))) {
+    cm_msg(MERROR, "dd_mcfd16_init", "MCFD16 not responding: no prompt within %d ms", (int) (ss_millitime() - phase));
+    return FE_ERR_HW;
+  }
+  t_prompt = ss_millitime() - phase;
+  phase = ss_millitime();
   
-  if (changed) mcfd_apply_settings(info); // TODO: only apply the changed ones...
+  remaining = MCFD_STARTUP_BUDGET - (int) (phase - start);
+  if (remaining <= 0 || mcfd_transaction(info, "v\r\n", &reply, min(DEFAULT_TIMEOUT, remaining)) <= 0) {
+    cm_msg(MERROR, "dd_mcfd16_init", "MCFD16 not responding: no answer to ``v''");
+    return FE_ERR_HW;
+  }
+  info->identity = mcfd_hash(reply.data, reply.len);
+  if (mcfd_find(reply.data, reply.data + reply.len, "MCFD-16") == NULL)
+    cm_msg(MERROR, "dd_mcfd16_init", "Device does not identify as an MCFD-16: ``%.*s''", reply.len, reply.data);
+  t_identity = ss_millitime() - phase;
+  
+  printf("MCFD16 startup: flush %d ms (%d bytes dropped), prompt %d ms, identity %d ms, total %d ms\n",
+         t_flush, dropped, t_prompt, t_identity, (int) (ss_millitime() - start));
+  return FE_SUCCESS;
+}
+
+// History File with %s replaced by the device name, so that every module of a class
+// driver gets a ring of its own.  Characters that do not belong in a file name become _.
+void mcfd_history_path(DD_MCFD_INFO * info, char * path, int size) {
+  std::string name;
+  for (const char* c = info->name; *c; ++c)
+    name += isalnum((unsigned char) *c) || *c == '-' || *c == '.' ? *c : '_';
+  const char* f = info->settings.history_file;
+  const char* at = strstr(f, "%s");
+  if (at == NULL)
+    snprintf(path, size, "%s", f);
+  else
+    snprintf(path, size, "%.*s%s%s", (int) (at - f), f, name.c_str(), at + 2);
+}
+
+
+// Undo a half done init: MIDAS does not call CMD_EXIT for a driver whose CMD_INIT failed,
+// so the hot-link, the history mapping and the port have to go here
+INT mcfd_init_failed(DD_MCFD_INFO* info, void** pinfo, INT status) {
+  HNDLE hDB;
+  cm_get_experiment_database(&hDB, NULL);
+  if (info->settings_open)
+    db_close_record(hDB, info->hkeydd);
+  info->bus.exit();
+  mcfd_history_close(&info->history);
+  delete info;
+  *pinfo = NULL;
+  return status;
 }
 
 
@@ -493,91 +1127,138 @@ INT dd_mcfd16_init(HNDLE hkey, void **pinfo, INT channels, INT(*bd)(INT cmd, ...
 
   cm_get_experiment_database(&hDB, NULL);
 
-  info->array = (float*) calloc(channels, sizeof(float));
-  info->update_time = (DWORD*) calloc(channels, sizeof(DWORD));
-  info->channel_frequency = (float*) calloc(channels, sizeof(float));
-  
-  for (int i=0; i<channels; ++i) { // TODO: obviously change this to be back to channels, just making notes for the meantime...
-    info->channel_frequency[i] = ss_nan(); // initialize the channel readouts to nan
-    info->array[i] = ss_nan();
-    info->update_time[i] = 0;
+  mcfd_channels_reset(&info->ch);
+  info->sweep_start = 0;
+  info->sweep_end = 0;
+  info->sweep_time = 0;
+  info->sweep_wall_ms = 0;
+  info->sweep_sequence = 0;
+  info->history.fd = -1;
+  info->history.header = NULL;
+  info->settings_open = false;
+  memset(info->dirty, 0, sizeof(info->dirty));
+  memset(info->shadow_known, 0, sizeof(info->shadow_known));
+  info->dump_hash = 0;
+  info->dump_known = 0;
+  info->identity = 0;
+  info->edit_first = 0;
+  info->edit_last = 0;
+  info->last_get_channel = -1;
+  for (int i=0; i<MCFD_NUM_RATES; ++i) {
+    info->alarm_state[i] = info->alarm_pending[i] = MCFD_ALARM_OK;
+    info->alarm_since[i] = 0;
   }
-  
-  info->get_label_calls=0;  
+  info->bus_alarm = false;
+  info->scan.active = false;
+  info->finder = MCFD_FINDER();
+  for (int l=0; l<MCFD_NUM_LANES; ++l) {
+    info->lane[l].depth = 0;
+    info->lane[l].served = 0;
+    mcfd_stats_reset(&info->lane[l].wait);
+  }
+  memset(info->queued, 0, sizeof(info->queued));
+  info->config_open = false;
+  info->config_retry = 0;
+  info->config_backoff = 0;
+  info->base_baud = info->bad_sweeps = 0;
+  for (int c=0; c<MCFD_NUM_CLASSES; ++c)
+    mcfd_rtt_reset(&info->rtt[c], 1, DEFAULT_TIMEOUT); // floor and ceiling once the settings are read
   
   info->num_channels = channels;  // TODO: make sure it is 19 channel readout
-  info->bd = bd;
   info->hkey = hkey;
+  KEY key;
+  if (db_get_key(hDB, hkey, &key) == DB_SUCCESS)
+    snprintf(info->name, sizeof(info->name), "%s", key.name);
+  else
+    snprintf(info->name, sizeof(info->name), "MCFD16");
 
   // DD Settings
   status = db_create_record(hDB, hkey, "DD", DD_MCFD_SETTINGS_STR); // should make the database correctly now...
   if (status != DB_SUCCESS)
-     return FE_ERR_ODB;
+     return mcfd_init_failed(info, pinfo, FE_ERR_ODB);
 
   status = db_find_key(hDB, hkey, "DD", &hkeydd);
+  info->hkeydd = hkeydd;
   if (status != DB_SUCCESS) {
-    return FE_ERR_ODB;
+    return mcfd_init_failed(info, pinfo, FE_ERR_ODB);
   }
   int size = sizeof(info->settingsIncoming);
   status = db_get_record(hDB, hkeydd, &info->settingsIncoming, &size, 0);
-  if (status != DB_SUCCESS) return FE_ERR_ODB;
+  if (status != DB_SUCCESS) return mcfd_init_failed(info, pinfo, FE_ERR_ODB);
 
   status = db_open_record(hDB, hkeydd, &info->settingsIncoming,
                           size, MODE_READ, mcfd_settings_updated, info);
   if (status != DB_SUCCESS) {
-    return FE_ERR_ODB;
+    return mcfd_init_failed(info, pinfo, FE_ERR_ODB);
   }
+  info->settings_open = true;
   memcpy(&info->settings, &info->settingsIncoming, sizeof(info->settingsIncoming));
-
-  // Initialize bus driver
-  status = info->bd(CMD_INIT, info->hkey, &info->bd_info);
-  if (status != SUCCESS) return status;
-  
-  printf("Sending initialization commands to MCFD16\n");
-  
-
-  char str[256];
-  memset(str, 0, sizeof(str));
-  int len=0;
-  // TODO: Check to see if MCFD16 is outputing data
-  BD_PUTS("ra 0\r\n"); // "get" measurement
-  int tries=0;
-  for (tries=0; tries<500; ++tries) {
-    int len = BD_GETS(str, sizeof(str)-1, "\n", 2); // will have to format this for MCFD, will need heavy testing
-    if (len==0 && tries > 4) break;
-  }
-  printf("read tries=%d, len=%d, str=``%s''\n", tries, len, str); // debugging
-  if (len == 0) {
-  }
-
-
-  BD_PUTS("ra 0\r\n");
-  len = BD_GETS(str, sizeof(str)-1, "\r\n", DEFAULT_TIMEOUT);  // EXTRA dummy read to readback "echo?"
-  len = BD_GETS(str, sizeof(str)-1, "\r\n", DEFAULT_TIMEOUT);
-  printf("ra 0 response = ``%s''\n",str);
-
-  for (tries=0; tries<500; ++tries) {
-    int len = BD_GETS(str, sizeof(str)-1, "\r\n", 2);
-    if (len==0 && tries > 2) break;
+  mcfd_set_dead_time(&info->ch, info->settings.set_dead_time, info->settings.set_width);
+  mcfd_set_deadlines(info);
+
+  // History file and ring size are taken once, a change applies at the next start
+  if (info->settings.history_file[0]) {
+    char path[256];
+    mcfd_history_path(info, path, sizeof(path));
+    if (mcfd_history_open(&info->history, path, std::max(info->settings.history_records, 0)) != 0)
+      cm_msg(MERROR, "dd_mcfd_init", "Cannot map rate history \"%s\" for %d records", path, info->settings.history_records);
+    else
+      printf("Rate history \"%s\": %llu of %llu records\n", path,
+             mcfd_history_head(&info->history) - mcfd_history_first(&info->history), info->history.header->capacity);
   }
 
+  // Open the port, socket or bus driver
+  status = info->bus.init(info->hkey, bd);
+  if (status != SUCCESS) return mcfd_init_failed(info, pinfo, status);
+  
+  status = mcfd_handshake(info);
+  if (status != FE_SUCCESS)
+    return mcfd_init_failed(info, pinfo, status);
+  info->base_baud = info->bus.line_rate();
+  if (info->base_baud > 0 && mcfd_fastest_baud(info->settings.max_baud) > info->base_baud)
+    mcfd_switch_baud(info, mcfd_fastest_baud(info->settings.max_baud)); // stays at base_baud if it fails
 
+  printf("Sending initialization commands to MCFD16\n");
+  int known = mcfd_read_shadow(info);
+  if (mcfd_config_unchanged(info))
+    return FE_SUCCESS; // nothing to write
+  printf("%d of %d registers read back from the settings dump\n", known, MCFD_NUM_SLOTS);
   mcfd_apply_settings(info); // settings are probably not functional, but they appear to be getting there...
-
+  //status = info->bd(CMD_EXIT, info->bd_info);
+  //printf("...\n%d", status);
+  
   return FE_SUCCESS;
 }
 
 //--------------------------------------------------------------------
 
+void mcfd_scan_finish(DD_MCFD_INFO* info, const char* how); // with the scan engine below
+void mcfd_finder_finish(DD_MCFD_INFO* info, bool aborted); // with the threshold finder below
+
 INT dd_mcfd_exit(DD_MCFD_INFO * info)
 {
   printf("Running dd_mcfd_exit\n");
+  if (info->scan.active)
+    mcfd_scan_finish(info, "stopped");
+  if (info->finder.active)
+    mcfd_finder_finish(info, true);
+  mcfd_flush_settings(info, true); // do not lose edits still inside the coalescing window
+  if (info->base_baud > 0 && info->bus.line_rate() != info->base_baud)
+    mcfd_switch_baud(info, info->base_baud); // leave the module where other tools expect it
+  
+  static const char* name[MCFD_NUM_CLASSES] = { "rate", "write", "dump" };
+  for (int c=0; c<MCFD_NUM_CLASSES; ++c)
+    printf("MCFD16 %s replies: %lu, p50 %d ms, p99 %d ms, deadline %d ms, %lu timeout(s)\n", name[c], info->rtt[c].count,
+           mcfd_rtt_percentile(&info->rtt[c], 0.5), mcfd_rtt_percentile(&info->rtt[c], 0.99), info->rtt[c].deadline, info->rtt[c].timeouts);
 
   // Close serial
-  info->bd(CMD_EXIT, info->bd_info);
+  HNDLE hDB;
+  cm_get_experiment_database(&hDB, NULL);
+  if (info->settings_open)
+    db_close_record(hDB, info->hkeydd); // no more hot-links into info
+  info->bus.exit();
+  mcfd_history_close(&info->history);
 
-//   if (info->array) free(info->array);
-//   if (info->update_time) free(info->update_time);
 //   delete info->recent;
   delete info;
 
@@ -586,32 +1267,26 @@ INT dd_mcfd_exit(DD_MCFD_INFO * info)
 
 //--------------------------------------------------------------------
 
-INT dd_mcfd_set(DD_MCFD_INFO * info, INT channel, float value)
+INT dd_mcfd_set(DD_MCFD_INFO * info, INT channel, int value) // TODO: make sure value is int everywhere...
 {
-  if (channel < 0 || channel >= info->num_channels)
-    return FE_ERR_DRIVER;
+  if (channel < 0 || channel >= info->num_channels) // This function may not be necessary since everything is in
+    return FE_ERR_DRIVER; // the settings now...
 
   channel+=info->num_channels;
 
-  char cmd[256];
-  char str[256];
-  memset(cmd, 0, sizeof(cmd));
-
-  printf("Set channel %d to %.2f\n", channel, value);
+  printf("Set channel %d to %d\n", channel, value);
   
   switch (channel) {
-    case CHAN_OUT_SP: // Setpoint
+    case TRIGGER_0_OUT: // Pulser status
       // TODO: make sure "value" is reasonable
-      info->set_point = value;
-      snprintf(cmd, sizeof(cmd)-1, "s%.2f\n", info->set_point);
-      BD_PUTS(cmd);
-      BD_GETS(str, sizeof(str)-1, "\r\n", DEFAULT_TIMEOUT); // read echo
-      printf("Setpoint to %.2f\n", info->set_point);
-      //cmd << "s" << value << "\n";
-      //BD_PUTS(cmd.str().c_str());
+      //info->settings.pulser = value;
+      //snprintf(cmd, sizeof(cmd)-1, "p%d\r\n", info->settings.pulser);
+      //BD_PUTS(cmd);
+      //BD_GETS(str, sizeof(str)-1, "\n", DEFAULT_TIMEOUT); // read echo
+      //printf("Pulser set to %d\n", info->settings.pulser);
       // TODO: make sure it was applied correctly...
       break;
-    case CHAN_OUT_RE:
+    case TRIGGER_1_OUT:
       // FIXME: not implemented
       //int ivalue = (int) value;
       //if (ivalue < 0 || ivalue > 255) {
@@ -626,56 +1301,560 @@ INT dd_mcfd_set(DD_MCFD_INFO * info, INT channel, float value)
 
 //--------------------------------------------------------------------
 
-INT dd_mcfd_get(DD_MCFD_INFO * info, INT channel, float *pvalue)
-{
-  // Get: PID Output and PV
+// ``Channel 3'', ``Trigger 0'' or ``Sum''
+void mcfd_rate_name(int i, char* name, int size) {
+  if (i < TRIGGER_0_OUT)
+    snprintf(name, size, "Channel %d", i);
+  else if (i < SUM_OUT)
+    snprintf(name, size, "Trigger %d", i - TRIGGER_0_OUT);
+  else
+    snprintf(name, size, "Sum");
+}
 
-  INT status = 0;
-  char str[256];
-  *pvalue = ss_nan();
-  memset(str, 0,sizeof(str)-1);
+// The condition a rate asks for, given the state it is in: a limit is crossed on the way
+// in, and only cleared once the rate is back inside by the hysteresis.
+int mcfd_alarm_condition(const DD_MCFD_SETTINGS* s, const MCFD_CHANNELS* ch, int i, int state) {
+  float r = ch->rate[i];
+  float in = 1 + s->alarm_hysteresis, out = 1 - s->alarm_hysteresis;
+  float high = s->alarm_high[i], low = s->alarm_low[i], rsd_max = s->alarm_max_rsd[i];
+  
+  if (high > 0 && r > (state == MCFD_ALARM_HIGH ? high * out : high))
+    return MCFD_ALARM_HIGH;
+  if (low > 0 && r < (state == MCFD_ALARM_LOW ? low * in : low))
+    return MCFD_ALARM_LOW;
+  const MCFD_STATS* st = &ch->stats[i];
+  if (rsd_max > 0 && st->n > 1 && st->mean > 0 &&
+      sqrt(mcfd_stats_variance(st)) / st->mean > (state == MCFD_ALARM_NOISY ? rsd_max * out : rsd_max))
+    return MCFD_ALARM_NOISY;
+  return MCFD_ALARM_OK;
+}
 
+// One pass over the sweep.  A new condition has to hold for the hold-off time before it
+// replaces the current state, and only the change of state reaches the alarm system, so
+// neither the cost nor the alarm traffic depends on how often the equipment is read.
+// Rates that failed to read keep their state, a sweep without any is the bus alarm.
+// Alarm names start with the device name, so modules of one equipment keep theirs apart.
+void mcfd_check_alarms(DD_MCFD_INFO* info) {
+  static const char* what[] = { "", "below", "above", "too noisy," };
+  const DD_MCFD_SETTINGS* s = &info->settings;
+  DWORD now = ss_millitime();
+  char name[12], alarm[NAME_LENGTH], msg[256]; // a rate name is ``Channel 15'' at most
+  
+  bool bus_failed = info->ch.valid == 0;
+  if (bus_failed != info->bus_alarm) {
+    info->bus_alarm = bus_failed;
+    snprintf(alarm, sizeof(alarm), "%.27s Bus", info->name);
+    snprintf(msg, sizeof(msg), "%s does not answer rate requests", info->name);
+    if (bus_failed)
+      al_trigger_alarm(alarm, msg, "Alarm", "", AT_INTERNAL);
+    else
+      al_reset_alarm(alarm);
+  }
+  
+  for (int i=0; i<MCFD_NUM_RATES; ++i) {
+    if (!(info->ch.valid & (1u << i)))
+      continue;
+    int want = mcfd_alarm_condition(s, &info->ch, i, info->alarm_state[i]);
+    if (want == info->alarm_state[i]) {
+      info->alarm_pending[i] = want;
+      continue;
+    }
+    if (want != info->alarm_pending[i]) {
+      info->alarm_pending[i] = want;
+      info->alarm_since[i] = now;
+    }
+    if ((int) (now - info->alarm_since[i]) < s->alarm_holdoff_ms)
+      continue;
+    
+    info->alarm_state[i] = want;
+    mcfd_rate_name(i, name, sizeof(name));
+    snprintf(alarm, sizeof(alarm), "%.19s %s", info->name, name); // within NAME_LENGTH, the limit of MIDAS alarm names
+    if (want == MCFD_ALARM_OK) {
+      al_reset_alarm(alarm);
+      continue;
+    }
+    float limit = want == MCFD_ALARM_HIGH ? s->alarm_high[i] : want == MCFD_ALARM_LOW ? s->alarm_low[i] : s->alarm_max_rsd[i];
+    if (want == MCFD_ALARM_NOISY)
+      snprintf(msg, sizeof(msg), "%s %s rate %s sd/mean above %g", info->name, name, what[want], limit);
+    else
+      snprintf(msg, sizeof(msg), "%s %s rate %.0f Hz %s %g Hz", info->name, name, info->ch.rate[i], what[want], limit);
+    al_trigger_alarm(alarm, msg, "Alarm", "", AT_INTERNAL);
+  }
+}
 
-  status = BD_PUTS("g\n");
-  if (status < 0) {
-    std::cerr << "BD_PUTS error." << std::endl;
-    al_trigger_alarm("FanPID", "Fan PID communication failure with Arduino.", 0, "BD_PUTS returns < 0", AT_INTERNAL);
-    return FE_ERR_HW;
+// A line rate raised at startup is given up, for good, after MCFD_BAUD_BAD_SWEEPS sweeps
+// in a row that lost more than a quarter of their rates
+void mcfd_check_link(DD_MCFD_INFO* info, int failed) {
+  if (info->base_baud == 0 || info->bus.line_rate() <= info->base_baud)
+    return;
+  info->bad_sweeps = failed > MCFD_NUM_RATES/4 ? info->bad_sweeps+1 : 0;
+  if (info->bad_sweeps < MCFD_BAUD_BAD_SWEEPS)
+    return;
+  cm_msg(MERROR, "mcfd_check_link", "MCFD16 link degraded at %d baud, back to %d", info->bus.line_rate(), info->base_baud);
+  mcfd_switch_baud(info, info->base_baud);
+}
+
+// Append the sweep to the mapped history, a copy into the page cache
+void mcfd_record_history(DD_MCFD_INFO * info) {
+  if (info->history.header == NULL)
+    return;
+  MCFD_HISTORY_RECORD r;
+  r.time_ms = info->sweep_wall_ms;
+  r.sequence = info->sweep_sequence;
+  r.duration_ms = info->sweep_end - info->sweep_start;
+  r.valid = info->ch.valid;
+  r.reserved = 0;
+  memcpy(r.rate, info->ch.rate, sizeof(r.rate));
+  mcfd_history_append(&info->history, &r);
+}
+
+// One rate, false if the module did not answer with the rate of channel i
+bool mcfd_read_rate(DD_MCFD_INFO * info, int i, float* value) {
+  char cmd[32];
+  MCFD_VIEW reply;
+  MCFD_RATE rate;
+  snprintf(cmd, sizeof(cmd)-1, "ra %d\r\n", i);
+  int len = mcfd_transaction(info, cmd, &reply); // echo, rate line and prompt in one read
+  if (len <= 0 || mcfd_parse_rate(reply.data, reply.len, &rate) != MCFD_PARSE_OK || rate.channel != i)
+    return false;
+  *value = rate.rate;
+  return true;
+}
+
+// Read all rates (16 channels, 3 triggers and the sum) back to back into info->ch so
+// they are sampled as close together as the bus allows.  A channel that does not answer
+// is set to NaN rather than keeping its previous value; update_time keeps the time of
+// its last good reading.
+int mcfd_sweep(DD_MCFD_INFO * info) {
+  int failed=0;
+  
+  info->sweep_start = ss_millitime();
+  info->sweep_time = ss_time();
+  info->sweep_wall_ms = mcfd_history_now_ms();
+  info->ch.valid = 0;
+  for (int i=0; i<info->num_channels && i<=SUM_OUT; ++i) {
+    float rate;
+    if (!mcfd_read_rate(info, i, &rate)) {
+      info->ch.rate[i] = ss_nan(); // stale, do not report the old value
+      failed++;
+      continue;
+    }
+    info->ch.rate[i] = rate;
+    info->ch.update_time[i] = ss_time();
+    mcfd_stats_add(&info->ch.stats[i], rate);
+    info->ch.valid |= 1u << i;
   }
-  //}
+  mcfd_derive(&info->ch);
+  mcfd_check_alarms(info);
+  info->sweep_end = ss_millitime();
+  info->sweep_sequence++;
+  mcfd_record_history(info);
+  mcfd_check_link(info, failed);
+  
+  if (failed)
+    std::cerr << "Error: " << failed << " rate(s) failed to refresh in sweep" << std::endl;
+  return failed ? FE_ERR_HW : FE_SUCCESS;
+}
 
-  status = BD_GETS(str, sizeof(str)-1, "\r\n", DEFAULT_TIMEOUT);  // EXTRA dummy read to readback "echo?"
-  ss_sleep(50);
-  status = BD_GETS(str, sizeof(str)-1, "\r\n", DEFAULT_TIMEOUT); 
-  if (status <= 0) {
-    std::cerr << "BD_GETS error." << std::endl;
+// Channels after the rates, see MCFD_NUM_VARIABLES.  NaN until the rate has a reading.
+float mcfd_stat_value(DD_MCFD_INFO * info, INT channel) {
+  if (channel >= MCFD_DERIVED_CORRECTED)
+    return info->ch.corrected[channel - MCFD_DERIVED_CORRECTED];
+  if (channel >= MCFD_DERIVED_ASYMMETRY)
+    return info->ch.asymmetry[channel - MCFD_DERIVED_ASYMMETRY];
+  if (channel >= MCFD_DERIVED_RATIO)
+    return info->ch.ratio[channel - MCFD_DERIVED_RATIO];
+  
+  int stat = channel / MCFD_NUM_RATES - 1;
+  const MCFD_STATS* s = &info->ch.stats[channel % MCFD_NUM_RATES];
+  if (s->n == 0)
+    return ss_nan();
+  switch (stat) {
+    case 0: return s->mean;
+    case 1: return mcfd_stats_variance(s);
+    case 2: return mcfd_stats_min(s);
+    case 3: return mcfd_stats_max(s);
+    case 4: return s->ewma;
   }
+  return ss_nan();
+}
 
-  float pv=0,co=0;
-  if ( sscanf(str,"%f\t%f",&pv,&co) != 2) {
-    std::cerr << "Error: Failed to parse data from Arduino." << std::endl;
-    std::cerr << "received: ``" << str << "''" << std::endl;
-//    al_trigger_alarm("FanPID", "Fan PID communication failure with Arduino.", 0, "Failed to parse received data", AT_INTERNAL); // TODO: re-enable this...
-    return FE_ERR_HW;
+// Threshold finder: the lowest threshold of every input at which its rate falls below
+// Threshold Target Hz, its noise edge.  All inputs are bisected at once over 0..255, so
+// one step is one pipelined batch of st commands, the settle time and one ra of each
+// input still searched, and nine steps cover the range where a linear scan would take 256.  It runs a step at a
+// time from CMD_GET like a scan, so the frontend keeps reading out while it searches.
+// The result is applied like any edit and written back to set_threshold.
+
+inline int mcfd_finder_probe(const MCFD_FINDER* f, int i) {
+  return min((f->lo[i] + f->hi[i]) / 2, MCFD_THRESHOLD_MAX);
+}
+
+// Write the probes of the next step, false if no input is left to search
+bool mcfd_finder_write(DD_MCFD_INFO* info) {
+  MCFD_FINDER* f = &info->finder;
+  MCFD_COMMAND batch[MCFD_INPUTS];
+  int n=0, ch[MCFD_INPUTS];
+  for (int i=0; i<MCFD_INPUTS; ++i) {
+    f->acked[i] = false;
+    if (f->lo[i] >= f->hi[i] || f->missed[i] >= MCFD_FINDER_RETRIES)
+      continue;
+    snprintf(batch[n].cmd, sizeof(batch[n].cmd), "st %d %d\r\n", i, mcfd_finder_probe(f, i));
+    batch[n].status = FE_ERR_HW;
+    ch[n++] = i;
   }
+  if (n == 0)
+    return false;
+  mcfd_submit_batch(info, batch, n);
+  for (int k=0; k<n; ++k)
+    f->acked[ch[k]] = batch[k].status == FE_SUCCESS;
+  f->written = ss_millitime();
+  f->settling = true;
+  return true;
+}
 
-   printf("PV=%.2f  CO=%.2f\n", pv, co);
+void mcfd_finder_start(DD_MCFD_INFO* info) {
+  MCFD_FINDER* f = &info->finder;
+  printf("Threshold finder: target %g Hz\n", info->settings.threshold_target_hz);
+  for (int i=0; i<MCFD_INPUTS; ++i) {
+    f->lo[i] = 0;
+    f->hi[i] = MCFD_THRESHOLD_MAX+1; // above the range: no threshold is quiet enough
+    f->missed[i] = 0;
+    mcfd_clear_dirty(info->dirty, MCFD_SLOT_THRESHOLD + i); // a queued write would spoil a probe, the result follows
+    info->queued[MCFD_SLOT_THRESHOLD + i] = 0;
+  }
+  f->steps = 0;
+  f->start = ss_millitime();
+  f->active = true;
+  mcfd_finder_write(info);
+}
 
-  switch (channel) {
-    case CHAN_INP_PV:
-      *pvalue = pv;
-      info->process_value = pv;
-      break;
-    case CHAN_INP_CO:
-      *pvalue = co;
-      info->controlled_output = co;
-      break;
-    default:
-      *pvalue = ss_nan();
-      break;
+// Take the result, or on abort the thresholds of the ODB, and pick up the edits deferred
+// while the search ran
+void mcfd_finder_finish(DD_MCFD_INFO* info, bool aborted) {
+  MCFD_FINDER* f = &info->finder;
+  DD_MCFD_SETTINGS* s = &info->settings;
+  f->active = false;
+  for (int i=0; i<MCFD_INPUTS && !aborted; ++i) {
+    if (f->missed[i] >= MCFD_FINDER_RETRIES)
+      cm_msg(MERROR, "mcfd_find_thresholds", "Channel %d: no rate, threshold stays at %d", i, s->set_threshold[i]);
+    else if (f->lo[i] > MCFD_THRESHOLD_MAX) {
+      cm_msg(MERROR, "mcfd_find_thresholds", "Channel %d: above %g Hz even at threshold %d", i, s->threshold_target_hz, MCFD_THRESHOLD_MAX);
+      s->set_threshold[i] = MCFD_THRESHOLD_MAX;
+    }
+    else {
+      printf("   channel %2d: threshold %d\n", i, f->lo[i]);
+      s->set_threshold[i] = f->lo[i];
+    }
+  }
+  s->find_thresholds = FALSE;
+  if (!aborted)
+    memcpy(info->settingsIncoming.set_threshold, s->set_threshold, sizeof(s->set_threshold));
+  info->settingsIncoming.find_thresholds = FALSE; // our own ODB write below finds nothing to do
+  mcfd_diff_settings(&info->settings, &info->settingsIncoming, info->dirty, false);
+  memcpy(&info->settings, &info->settingsIncoming, sizeof(info->settingsIncoming));
+  mcfd_set_dead_time(&info->ch, s->set_dead_time, s->set_width);
+  mcfd_set_deadlines(info);
+  
+  // The search left the module on its last probes, the shadow no longer knows them
+  for (int i=0; i<MCFD_INPUTS; ++i) {
+    mcfd_clear_dirty(info->shadow_known, MCFD_SLOT_THRESHOLD + i);
+    mcfd_set_dirty(info->dirty, MCFD_SLOT_THRESHOLD + i);
+  }
+  mcfd_apply_dirty(info);
+  
+  HNDLE hDB;
+  cm_get_experiment_database(&hDB, NULL);
+  if (!aborted)
+    db_set_value(hDB, info->hkeydd, "set_threshold", s->set_threshold, sizeof(s->set_threshold), MCFD_INPUTS, TID_INT);
+  db_set_value(hDB, info->hkeydd, "Find Thresholds", &s->find_thresholds, sizeof(BOOL), 1, TID_BOOL);
+  printf("Threshold finder: %s after %d steps in %d ms\n", aborted ? "aborted" : "done", f->steps, (int) (ss_millitime() - f->start));
+}
+
+// One step of the search, from every CMD_GET: once the probes have settled the inputs
+// still searched read their rates and narrow their intervals, the next call writes the
+// next probes.  No call does more than one batch or one round of reads.  The probe rates
+// stay out of info->ch, the readout keeps its own sweeps.
+void mcfd_finder_step(DD_MCFD_INFO* info) {
+  MCFD_FINDER* f = &info->finder;
+  if (!f->active) {
+    mcfd_finder_start(info);
+    return;
+  }
+  if (!info->settingsIncoming.find_thresholds) {
+    mcfd_finder_finish(info, true);
+    return;
+  }
+  if (!f->settling) {
+    if (!mcfd_finder_write(info))
+      mcfd_finder_finish(info, false);
+    return;
+  }
+  if ((int) (ss_millitime() - f->written) < info->settings.threshold_settle_ms)
+    return;
+  
+  f->settling = false;
+  for (int i=0; i<MCFD_INPUTS; ++i) {
+    if (f->lo[i] >= f->hi[i] || f->missed[i] >= MCFD_FINDER_RETRIES)
+      continue;
+    float rate;
+    if (!f->acked[i] || !mcfd_read_rate(info, i, &rate)) {
+      f->missed[i]++; // same step again
+      continue;
+    }
+    if (rate < info->settings.threshold_target_hz)
+      f->hi[i] = mcfd_finder_probe(f, i);
+    else
+      f->lo[i] = mcfd_finder_probe(f, i)+1;
+  }
+  f->steps++;
+}
+
+// Members a scan can step through
+static const MCFD_SETTINGS_FIELD mcfd_scan_fields[] = {
+  { "set_threshold", offsetof(DD_MCFD_SETTINGS, set_threshold), 16, 0 },
+  { "set_polarity", offsetof(DD_MCFD_SETTINGS, set_polarity), 8, 0 },
+  { "set_gain", offsetof(DD_MCFD_SETTINGS, set_gain), 8, 0 },
+  { "set_width", offsetof(DD_MCFD_SETTINGS, set_width), 8, 0 },
+  { "set_dead_time", offsetof(DD_MCFD_SETTINGS, set_dead_time), 8, 0 },
+  { "set_delay_line", offsetof(DD_MCFD_SETTINGS, set_delay_line), 8, 0 },
+  { "set_fraction", offsetof(DD_MCFD_SETTINGS, set_fraction), 8, 0 },
+  { "trigger_source", offsetof(DD_MCFD_SETTINGS, trigger_source), 3, 0 },
+  { "trigger_monitor", offsetof(DD_MCFD_SETTINGS, trigger_monitor), 2, 0 },
+  { "set_multiplicity", offsetof(DD_MCFD_SETTINGS, set_multiplicity), 2, 0 },
+  { "paired_coincidence", offsetof(DD_MCFD_SETTINGS, paired_coincidence), 15, 0 },
+  { "BWL", offsetof(DD_MCFD_SETTINGS, BWL), 1, 0 },
+  { "CFD", offsetof(DD_MCFD_SETTINGS, CFD), 1, 0 },
+  { "set_mask", offsetof(DD_MCFD_SETTINGS, set_mask), 1, 0 },
+  { "set_coincidence", offsetof(DD_MCFD_SETTINGS, set_coincidence), 1, 0 },
+  { "set_veto", offsetof(DD_MCFD_SETTINGS, set_veto), 1, 0 },
+  { "gate_selector", offsetof(DD_MCFD_SETTINGS, gate_selector), 1, 0 },
+  { "gate_timing", offsetof(DD_MCFD_SETTINGS, gate_timing), 1, 0 },
+  { "pulser", offsetof(DD_MCFD_SETTINGS, pulser), 1, 0 },
+};
+
+const MCFD_SETTINGS_FIELD* mcfd_scan_field(const char* name) {
+  for (size_t f=0; f<sizeof(mcfd_scan_fields)/sizeof(mcfd_scan_fields[0]); ++f)
+    if (strcmp(mcfd_scan_fields[f].label, name) == 0)
+      return &mcfd_scan_fields[f];
+  return NULL;
+}
+
+int mcfd_scan_field_count(const char* name) {
+  const MCFD_SETTINGS_FIELD* field = mcfd_scan_field(name);
+  return field ? field->count : 0;
+}
+
+// Put the values of point p into settings and write only the commands that changed.  No
+// readback: a scan would spend more time verifying than measuring.
+void mcfd_scan_apply_point(DD_MCFD_INFO* info, unsigned p) {
+  const MCFD_SCAN_HEADER* h = &info->scan.header;
+  DD_MCFD_SETTINGS before = info->settings;
+  for (int d=0; d<h->ndims; ++d) {
+    const MCFD_SETTINGS_FIELD* field = mcfd_scan_field(h->dim[d].field);
+    int* dest = (int*) ((char*) &info->settings + field->offset);
+    int v = h->dim[d].value[mcfd_scan_index(h, p, d)];
+    for (int i=0; i<field->count; ++i)
+      if (h->dim[d].channels & (1u << i))
+        dest[i] = v;
+  }
+  mcfd_diff_settings(&before, &info->settings, info->dirty, false);
+  mcfd_apply_dirty(info, false);
+  info->scan.applied = ss_millitime();
+}
+
+// Clear Run Scan in the ODB and in both copies of the settings
+void mcfd_scan_clear_flag(DD_MCFD_INFO* info) {
+  HNDLE hDB;
+  info->settings.run_scan = info->settingsIncoming.run_scan = FALSE;
+  cm_get_experiment_database(&hDB, NULL);
+  db_set_value(hDB, info->hkeydd, "Run Scan", &info->settings.run_scan, sizeof(BOOL), 1, TID_BOOL);
+}
+
+// Back to the ODB settings, with any edit made while the scan ran, verified as usual
+void mcfd_scan_finish(DD_MCFD_INFO* info, const char* how) {
+  MCFD_SCAN* scan = &info->scan;
+  fclose(scan->file);
+  scan->active = false;
+  printf("Scan %s after %u of %u points, %d s\n", how, scan->point, scan->header.npoints,
+         (int) (ss_time() - scan->header.start_time));
+  
+  mcfd_scan_clear_flag(info);
+  mcfd_diff_settings(&info->settings, &info->settingsIncoming, info->dirty, false);
+  memcpy(&info->settings, &info->settingsIncoming, sizeof(info->settingsIncoming));
+  mcfd_set_dead_time(&info->ch, info->settings.set_dead_time, info->settings.set_width);
+  mcfd_set_deadlines(info);
+  mcfd_apply_dirty(info);
+}
+
+void mcfd_scan_start(DD_MCFD_INFO* info) {
+  MCFD_SCAN* scan = &info->scan;
+  MCFD_SCAN_HEADER* h = &scan->header;
+  memset(h, 0, sizeof(*h));
+  
+  const char* error = mcfd_parse_scan(info->settings.scan, h, mcfd_scan_field_count);
+  if (error) {
+    cm_msg(MERROR, "mcfd_scan_start", "Scan \"%s\": %s", info->settings.scan, error);
+    mcfd_scan_clear_flag(info);
+    return;
+  }
+  scan->file = fopen(info->settings.scan_file, "wb");
+  if (scan->file == NULL) {
+    cm_msg(MERROR, "mcfd_scan_start", "Cannot write scan file \"%s\"", info->settings.scan_file);
+    mcfd_scan_clear_flag(info);
+    return;
+  }
+  memcpy(h->magic, MCFD_SCAN_MAGIC, sizeof(h->magic));
+  h->header_size = sizeof(MCFD_SCAN_HEADER);
+  h->record_size = sizeof(MCFD_SCAN_RECORD);
+  h->start_time = ss_time();
+  h->dwell_ms = info->settings.scan_dwell_ms;
+  fwrite(h, sizeof(*h), 1, scan->file);
+  
+  printf("Scan \"%s\": %u points, %d ms each, to \"%s\"\n", h->description, h->npoints, h->dwell_ms, info->settings.scan_file);
+  scan->active = true;
+  scan->point = 0;
+  mcfd_scan_apply_point(info, 0);
+}
+
+// One step of a running scan, from every CMD_GET: once the dwell time is over the point
+// gets a sweep of its own, its record is written and the next point applied.  The frontend
+// keeps running in between.
+void mcfd_scan_step(DD_MCFD_INFO* info) {
+  MCFD_SCAN* scan = &info->scan;
+  if (!scan->active) {
+    mcfd_scan_start(info);
+    return;
+  }
+  if (!info->settingsIncoming.run_scan) {
+    mcfd_scan_finish(info, "aborted");
+    return;
+  }
+  if ((int) (ss_millitime() - scan->applied) < (int) scan->header.dwell_ms)
+    return;
+  
+  const MCFD_SCAN_HEADER* h = &scan->header;
+  MCFD_SCAN_RECORD record;
+  memset(&record, 0, sizeof(record));
+  mcfd_sweep(info);
+  record.point = scan->point;
+  record.time = info->sweep_time;
+  record.valid = info->ch.valid;
+  for (int d=0; d<h->ndims; ++d)
+    record.value[d] = h->dim[d].value[mcfd_scan_index(h, scan->point, d)];
+  memcpy(record.rate, info->ch.rate, sizeof(record.rate));
+  fwrite(&record, sizeof(record), 1, scan->file);
+  fflush(scan->file); // an interrupted scan keeps every point it finished
+  
+  if (++scan->point >= h->npoints)
+    mcfd_scan_finish(info, "done");
+  else
+    mcfd_scan_apply_point(info, scan->point);
+}
+
+// The bus scheduler, one step per CMD_GET.  The lanes share the bus in priority order:
+//   control  veto and pulser, written straight from the hotlink, between two steps
+//   poll     the rate sweep once it is due, on the first request of a readout pass
+//            unless an apply is in progress
+//   config   all other registers, at most Config Chunk commands per step
+// A long apply holds up the rate sweep by one chunk at most, and the sweep cannot starve
+// the apply either, since every step with the config lane open writes a chunk.  Once the
+// lane is empty, or the module stops acknowledging, it closes with one verify as usual.
+// Unacknowledged commands stay dirty and the lane reopens for them after a back-off that
+// doubles while they keep failing.  swept skips the poll lane when a scan step has just
+// taken a sweep of its own.
+void mcfd_schedule(DD_MCFD_INFO* info, bool new_pass, bool swept=false) {
+  DWORD now = ss_millitime();
+  DWORD due = info->sweep_start + (DWORD) info->settings.readPeriod_ms;
+  bool poll_due = info->sweep_start == 0 || (int) (now - due) >= 0;
+  info->lane[MCFD_LANE_POLL].depth = poll_due ? info->num_channels < MCFD_NUM_RATES ? info->num_channels : MCFD_NUM_RATES : 0;
+  if (poll_due && !swept && (new_pass || info->sweep_start == 0 || info->config_open)) {
+    if (info->sweep_start != 0)
+      mcfd_lane_served(&info->lane[MCFD_LANE_POLL], now - due);
+    mcfd_sweep(info);
+    info->lane[MCFD_LANE_POLL].depth = 0;
+  }
+  
+  if (!info->config_open) {
+    if (info->config_retry == 0 || (int) (now - info->config_retry) < 0)
+      return;
+    info->config_retry = 0;
+    mcfd_queue_dirty(info);
+    if (info->lane[MCFD_LANE_CONFIG].depth == 0)
+      return;
+    printf("Retrying %d unacknowledged setting(s)\n", info->lane[MCFD_LANE_CONFIG].depth);
+    info->config_open = true;
+    info->config_written = 0;
+  }
+  int written;
+  int chunk = info->settings.config_chunk > 0 ? info->settings.config_chunk : MCFD_MAX_BATCH;
+  int status = mcfd_write_dirty(info, MCFD_LANE_CONFIG, chunk, &written);
+  info->config_written += written;
+  if (status == FE_SUCCESS && info->lane[MCFD_LANE_CONFIG].depth > 0)
+    return;
+  info->config_open = false;
+  if (info->lane[MCFD_LANE_CONFIG].depth > 0) {
+    info->config_backoff = info->config_backoff ? min(2*info->config_backoff, MCFD_CONFIG_RETRY_MAX) : MCFD_CONFIG_RETRY_MIN;
+    info->config_retry = (now + info->config_backoff) | 1; // 0 means no retry
+    cm_msg(MERROR, "mcfd_schedule", "MCFD16 did not acknowledge %d setting(s), retrying in %d s",
+           info->lane[MCFD_LANE_CONFIG].depth, info->config_backoff / 1000);
+  }
+  else
+    info->config_backoff = 0;
+  if (info->config_written > 0 && mcfd_verify_settings(info) != 0)
+    status = FE_ERR_HW;
+  if (status == FE_SUCCESS)
+    mcfd_save_config(info);
+}
+
+// Lane metrics after the derived quantities, see MCFD_LANE_METRICS
+float mcfd_lane_value(DD_MCFD_INFO* info, INT channel) {
+  const MCFD_LANE* lane = &info->lane[(channel - MCFD_LANE_METRICS) / 3];
+  switch ((channel - MCFD_LANE_METRICS) % 3) {
+    case 0: return lane->depth;
+    case 1: return lane->wait.n ? lane->wait.mean : ss_nan();
+    case 2: return lane->wait.n ? mcfd_stats_max(&lane->wait) : ss_nan();
   }
+  return ss_nan();
+}
+
+// Everything the driver does between two readouts: pending edits, a step of the threshold
+// finder or else of a scan, and one step of the bus scheduler
+void mcfd_poll(DD_MCFD_INFO* info, bool new_pass) {
+  DWORD sweeps = info->sweep_sequence;
+  mcfd_flush_settings(info);
+  if (info->finder.active || (info->settings.find_thresholds && !info->scan.active))
+    mcfd_finder_step(info);
+  else if (info->scan.active || info->settings.run_scan)
+    mcfd_scan_step(info);
+  mcfd_schedule(info, new_pass, info->sweep_sequence != sweeps);
+}
+
+// One variable from the cache, see MCFD_NUM_VARIABLES
+float mcfd_variable(DD_MCFD_INFO* info, INT channel) {
+  if (channel < MCFD_NUM_RATES)
+    return info->ch.rate[channel];
+  if (channel == MCFD_LINE_RATE)
+    return info->bus.line_rate() > 0 ? info->bus.line_rate() : ss_nan();
+  if (channel >= MCFD_LANE_METRICS)
+    return mcfd_lane_value(info, channel);
+  return mcfd_stat_value(info, channel);
+}
 
-  //ss_sleep(1);
+INT dd_mcfd_get(DD_MCFD_INFO * info, INT channel, float *pvalue)
+{
+  *pvalue = ss_nan();
+  if (channel < 0 || channel >= info->num_channels || channel >= MCFD_NUM_VARIABLES)
+    return FE_ERR_DRIVER;
+  
+  // cd_multi asks for one channel at a time.  The first request of a readout pass sweeps
+  // the whole module if the snapshot is older than the read period, the rest of the pass
+  // is answered from the cache.
+  bool new_pass = channel <= info->last_get_channel;
+  info->last_get_channel = channel;
+  mcfd_poll(info, new_pass);
+  
+  *pvalue = mcfd_variable(info, channel);
   return FE_SUCCESS;
 }
 
@@ -683,81 +1862,56 @@ INT dd_mcfd_get(DD_MCFD_INFO * info, INT channel, float *pvalue)
 
 INT dd_mcfd_get_label(DD_MCFD_INFO * info, INT channel, char *name)
 {
-
-  // Keep track of calls to this function to get right channel labels with multi.c class driver.
-  if (info->num_channels==2 && info->get_label_calls > info->num_channels/2) {
-    channel+=info->num_channels;
+  if (channel == MCFD_LINE_RATE) {
+    strncpy(name, "Line rate baud", NAME_LENGTH-1);
+    return FE_SUCCESS;
+  }
+  else if (channel >= MCFD_LANE_METRICS) {
+    static const char* lane[MCFD_NUM_LANES] = { "Control", "Poll", "Config" };
+    static const char* metric[3] = { "lane depth", "lane wait ms", "lane max wait ms" };
+    snprintf(name, NAME_LENGTH-1, "%s %s", lane[(channel - MCFD_LANE_METRICS) / 3], metric[(channel - MCFD_LANE_METRICS) % 3]);
+    return FE_SUCCESS;
+  }
+  else if (channel >= MCFD_DERIVED_CORRECTED) {
+    snprintf(name, NAME_LENGTH-1, "Channel %d corrected Hz", (channel - MCFD_DERIVED_CORRECTED) % MCFD_INPUTS); // 2 digits at most
+    return FE_SUCCESS;
+  }
+  else if (channel >= MCFD_DERIVED_ASYMMETRY) {
+    snprintf(name, NAME_LENGTH-1, "Pair %d asymmetry", channel - MCFD_DERIVED_ASYMMETRY);
+    return FE_SUCCESS;
+  }
+  else if (channel >= MCFD_DERIVED_RATIO) {
+    snprintf(name, NAME_LENGTH-1, "Channel %d / sum", channel - MCFD_DERIVED_RATIO);
+    return FE_SUCCESS;
+  }
+  else if (channel >= MCFD_NUM_RATES) { // rolling statistic of a rate
+    static const char* stat[MCFD_NUM_STATS] = { "mean Hz", "variance Hz^2", "min Hz", "max Hz", "EWMA Hz" };
+    char rate[16]; // ``Channel 15'' at most, leaves room for the statistic
+    mcfd_rate_name(channel % MCFD_NUM_RATES, rate, sizeof(rate));
+    memset(name, 0, NAME_LENGTH);
+    snprintf(name, NAME_LENGTH-1, "%s %s", rate, stat[channel / MCFD_NUM_RATES - 1]);
+    return FE_SUCCESS;
   }
 
   switch (channel) {
-    case CHAN_INP_POLARITY:
-      strncpy(name, "Pairing Polarity", NAME_LENGTH-1);
+    case TRIGGER_0_OUT:
+      strncpy(name, "Trigger 0 (Hz)", NAME_LENGTH-1);
       break;
-    case CHAN_INP_GAIN:
-      strncpy(name, "Pairing Gain", NAME_LENGTH-1);
+    case TRIGGER_1_OUT:
+      strncpy(name, "Trigger 1 (Hz)", NAME_LENGTH-1);
       break;
-    case CHAN_INP_THRESHOLD:
-      strncpy(name, "Threshold Setpoint", NAME_LENGTH-1);
+    case TRIGGER_2_OUT:
+      strncpy(name, "Trigger 2 (Hz)", NAME_LENGTH-1);
       break;
-    case CHAN_INP_WIDTH:
-      strncpy(name, "Pairing Width", NAME_LENGTH-1);
-      break;
-    case CHAN_INP_DEAD_TIME:
-      strncpy(name, "Pairing Dead Time", NAME_LENGTH-1);
-      break;
-    case CHAN_INP_DELAY_LINE:
-      strncpy(name, "Pairing Delay Line", NAME_LENGTH-1);
-      break;
-    case CHAN_INP_FRACTION:
-      strncpy(name, "Pairing Fraction", NAME_LENGTH-1);
-      break;
-    case CHAN_INP_TRIGGER_SOURCE:
-      strncpy(name, "Trigger Source", NAME_LENGTH-1);
-      break;
-    case CHAN_INP_TRIGGER_PATTERN:
-      strncpy(name, "Trigger Pattern", NAME_LENGTH-1);
-      break;
-    case CHAN_INP_MULTIPLICITY:
-      strncpy(name, "Multiplicity Setpoint", NAME_LENGTH-1);
-      break;
-    case CHAN_INP_PAIRED_COINCIDENCE:
-      strncpy(name, "Paired Coincidence", NAME_LENGTH-1);
-      break;
-    case CHAN_INP_BWL:
-      strncpy(name, "Bandwidth Limit", NAME_LENGTH-1);
-      break;
-    case CHAN_INP_CFD:
-      strncpy(name, "Constant Fraction Discrimination", NAME_LENGTH-1);
-      break;
-    case CHAN_INP_SET_MASK:
-      strncpy(name, "Mask Registers", NAME_LENGTH-1);
-      break;
-    case CHAN_INP_SET_COINCIDENCE:
-      strncpy(name, "Global Coincidence", NAME_LENGTH-1);
-      break;
-    case CHAN_INP_SET_VETO:
-      strncpy(name, "Enable Fast Veto", NAME_LENGTH-1);
-      break;
-    case CHAN_INP_GATE_SELECTOR:
-      strncpy(name, "Gate Select", NAME_LENGTH-1);
-      break;
-    case CHAN_INP_GATE_TIMING:
-      strncpy(name, "Gate Timing", NAME_LENGTH-1);
-      break;
-    case CHAN_INP_PULSER:
-      strncpy(name, "Pulser", NAME_LENGTH-1);
-      break;
-    case CHAN_OUT_RE:
-      strncpy(name, "reserved", NAME_LENGTH-1);
+    case SUM_OUT:
+      strncpy(name, "Sum (Hz)", NAME_LENGTH-1);
       break;
     default:
-      //snprintf(name,"");
       memset(name, 0, NAME_LENGTH);
+      snprintf(name, NAME_LENGTH-1, "Channel %d Hz", channel);
       //return FE_ERR_DRIVER;
   }
 
-  //printf("dd_arduino_fan_pid_get_label: chan=%d, Name=``%s''\n",channel,name);
-  info->get_label_calls++;
   return FE_SUCCESS;
 }
 
@@ -766,7 +1920,34 @@ INT dd_mcfd_get_label(DD_MCFD_INFO * info, INT channel, char *name)
 extern "C" {
 #endif
 
-INT dd_mcfd(INT cmd, ...)
+// Copy of the latest sweep for the rate bank equipment, from the driver's cache only
+INT dd_mcfd16_rates(void *dd_info, MCFD_RATE_BANK *bank)
+{
+  DD_MCFD_INFO *info = (DD_MCFD_INFO*) dd_info;
+  bank->start_ms = info->sweep_wall_ms;
+  bank->sequence = info->sweep_sequence;
+  bank->duration_ms = info->sweep_end - info->sweep_start;
+  bank->device = 0; // the class driver knows the position in the list
+  bank->valid = info->ch.valid;
+  for (int i=0; i<MCFD_BANK_RATES; ++i)
+    bank->rate[i] = info->ch.rate[i];
+  return FE_SUCCESS;
+}
+
+// The whole variable set at once for cd_mcfd16: one poll, which sweeps if the read period
+// is over, then the first n variables from the cache, and the sweep sequence they belong
+// to.  FE_ERR_HW once a sweep could not read any rate, until one does again.
+INT dd_mcfd16_snapshot(void *dd_info, float *values, INT n, DWORD *sequence)
+{
+  DD_MCFD_INFO *info = (DD_MCFD_INFO*) dd_info;
+  mcfd_poll(info, true);
+  for (int c=0; c<n; ++c)
+    values[c] = c < info->num_channels && c < MCFD_NUM_VARIABLES ? mcfd_variable(info, c) : ss_nan();
+  *sequence = info->sweep_sequence;
+  return info->sweep_sequence > 0 && info->ch.valid == 0 ? FE_ERR_HW : FE_SUCCESS;
+}
+
+INT dd_mcfd16(INT cmd, ...)
 {
   va_list argptr;
   HNDLE hKey;
@@ -787,7 +1968,7 @@ INT dd_mcfd(INT cmd, ...)
       flags = va_arg(argptr, DWORD);
       if (flags==0) {} // prevent set-but-unused compile warning
       bd = va_arg(argptr, void *);
-      status = dd_mcfd_init(hKey, (void**)info, channel, (INT (*)(INT, ...)) bd);
+      status = dd_mcfd16_init(hKey, (void**)info, channel, (INT (*)(INT, ...)) bd);
       break;
 
     case CMD_EXIT:
@@ -798,7 +1979,7 @@ INT dd_mcfd(INT cmd, ...)
     case CMD_SET:
       info = va_arg(argptr, void *);
       channel = va_arg(argptr, INT);
-      value = (float) va_arg(argptr, double);
+      value = (int) va_arg(argptr, double); // probably will break...
       status = dd_mcfd_set((DD_MCFD_INFO*) info, channel, value);
       break;
 
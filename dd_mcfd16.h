@@ -8,10 +8,41 @@
   $Id: $
 
 \********************************************************************/
+
+// Fixed layout of one rate sweep, as written to the MCRT bank, one after the other for
+// every module with a new sweep.  Rates are in Hz in the driver's channel order: 0-15
+// inputs, 16-18 triggers, 19 sum.  The start time is the one the rate history has.
+#define MCFD_BANK_RATES 20
+
+typedef struct {
+  unsigned long long start_ms; // wall clock ms since the epoch at the start of the sweep
+  DWORD sequence;              // sweep counter of the module, 0 before the first sweep
+  DWORD duration_ms;           // how long the sweep took
+  DWORD device;                // index of the module in the equipment's device driver list
+  DWORD valid;                 // bit i set if rate[i] was read in this sweep
+  float rate[MCFD_BANK_RATES];
+} MCFD_RATE_BANK;
+
+// Slow control variables: the MCFD_BANK_RATES rates, then the same channels again for
+// each rolling statistic over the last sweeps (see mcfd_stats.h), in the order mean,
+// variance, min, max, EWMA, then the quantities derived from each sweep (see
+// mcfd_channels.h), then the depth, mean and max wait of each bus scheduler lane (control,
+// poll, config) and the serial line rate.  A device table with only MCFD_BANK_RATES
+// channels gets the rates alone.
+#define MCFD_NUM_STATS 5
+#define MCFD_DERIVED_RATIO (MCFD_BANK_RATES * (1 + MCFD_NUM_STATS)) // 16 input / sum ratios
+#define MCFD_DERIVED_ASYMMETRY (MCFD_DERIVED_RATIO + 16)           // 8 pair asymmetries
+#define MCFD_DERIVED_CORRECTED (MCFD_DERIVED_ASYMMETRY + 8)        // 16 dead time corrected rates, Hz
+#define MCFD_LANE_METRICS (MCFD_DERIVED_CORRECTED + 16)            // 3 per lane, wait times in ms
+#define MCFD_LINE_RATE (MCFD_LANE_METRICS + 3 * 3)                // baud, NaN when not on a serial port
+#define MCFD_NUM_VARIABLES (MCFD_LINE_RATE + 1)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 INT dd_mcfd16(INT cmd, ...);
+INT dd_mcfd16_rates(void *dd_info, MCFD_RATE_BANK *bank); // latest sweep of the driver instance
+INT dd_mcfd16_snapshot(void *dd_info, float *values, INT n, DWORD *sequence); // all variables at once, see cd_mcfd16.cxx
 #ifdef __cplusplus
 }
 #endif
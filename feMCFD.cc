@@ -3,7 +3,10 @@
 //  Name:         feMCFD.cc
 //  Created by:   Kolby Kiesling
 //
-//  Contents:     Slow control readout of MCFD16
+//  Contents:     Slow control readout of MCFD16.  The same source for
+//                every build, the Makefiles pick the transport with
+//                -DMCFD_TRANSPORT (see mcfd_transport.h).  Only the
+//                replay build goes through a MIDAS bus driver.
 //
 //  $Id: $
 //
@@ -18,8 +21,13 @@
 //#ifdef __cplusplus
 //extern "C" {
 //#endif
-#include "rs232.h"  // $MIDASSYS/drivers/bus
-#include "multi.h"  // $MIDASSYS/drivers/class
+#ifdef MCFD_REPLAY
+#include "replay.h" // answers from Transcript instead of the module, see replay.cxx
+#define MCFD_BD replay
+#else
+#define MCFD_BD NULL // the driver opens the port or socket itself, its settings are in the device's BD record
+#endif
+#include "cd_mcfd16.h" // one snapshot per sweep instead of cd_multi's CMD_GET per channel
 //#ifdef __cplusplus
 //}
 //#endif
@@ -40,12 +48,16 @@ INT max_event_size = 2048;                    // maximum size of produced events
 INT max_event_size_frag = 5 * max_event_size; // maximum size for fragmented events (EQ_FRAGMENTED)
 INT event_buffer_size = 10 * max_event_size;  // buffer size to hold events
 
+INT read_rate_event(char *pevent, INT off);
+
 //-- Equipment list --------------------------------------------------
 
 // device driver list
 
+#define NUM_CHANNELS MCFD_NUM_VARIABLES // the rates and their rolling statistics, see dd_mcfd16.h
+
 DEVICE_DRIVER mcfd_driver[] = {
-   {"MCFD16", dd_mcfd16, 19, rs232, DF_INPUT | DF_OUTPUT},
+   {"MCFD16", dd_mcfd16, NUM_CHANNELS, MCFD_BD, DF_INPUT},
    {""}
 };
 
@@ -64,12 +76,28 @@ EQUIPMENT equipment[] = {
          0,                       // number of sub events
          60,                      // log history (minimum interval in seconds, 0==disabled)
          "", "", ""} ,
-      cd_multi_read,              // readout routine
-      cd_multi,                   // class driver main routine
+      cd_mcfd16_read,             // readout routine
+      cd_mcfd16,                  // class driver main routine
       mcfd_driver,             // device driver list
       NULL,                       // init string
    },
 
+   {"MCFD16 Rates",                       // equipment name
+      {16, 0,                     // event ID, trigger mask
+         "SYSTEM",                // event buffer
+         EQ_PERIODIC,             // equipment type
+         0,                       // event source
+         "MIDAS",                 // format
+         TRUE,                    // enabled
+         RO_RUNNING,              // read only when running
+         50,                      // look for a new sweep every 50 ms, an event is only sent when there is one
+         0,                       // stop run after this event limit
+         0,                       // number of sub events
+         0,                       // no history, the slow control equipment above has it
+         "", "", ""} ,
+      read_rate_event,            // readout routine
+   },
+
    {""}
 };
 
@@ -88,6 +116,14 @@ INT interrupt_configure(INT cmd, INT source, POINTER_T adr)
    return 1;
 }
 
+//-- Rate bank -------------------------------------------------------
+
+// The new sweeps of every MCFD16 of the slow control equipment, see cd_mcfd16_rate_bank()
+INT read_rate_event(char *pevent, INT off)
+{
+   return cd_mcfd16_rate_bank(&equipment[0], pevent);
+}
+
 //-- Frontend Init ---------------------------------------------------
 
 INT frontend_init()
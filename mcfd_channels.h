@@ -0,0 +1,89 @@
+/********************************************************************\
+
+  Name:         mcfd_channels.h
+  Created by:   Kolby Kiesling
+
+  Contents:     Per-channel state of one MCFD16 as parallel arrays,
+                and the per-sweep kernels for the quantities derived
+                from the rates.  The kernels are straight loops over
+                fixed-length arrays without branches, which gcc turns
+                into SIMD code from -O2 on; at -Os they stay scalar,
+                so the Makefiles build the driver with KERNELFLAGS.
+                Does not depend on MIDAS.
+
+  $Id: $
+
+\********************************************************************/
+#ifndef MCFD_CHANNELS_H
+#define MCFD_CHANNELS_H
+
+#include <cmath>
+#include "mcfd_parse.h"
+#include "mcfd_stats.h"
+
+#define MCFD_INPUTS 16
+#define MCFD_PAIRS 8             // pair k is inputs 2k and 2k+1, they share width and dead time
+#define MCFD_ALIGN 16            // one SSE vector, what operator new guarantees before C++17
+
+typedef struct {
+  alignas(MCFD_ALIGN) float rate[MCFD_NUM_RATES];          // Hz, NaN if the last read failed
+  alignas(MCFD_ALIGN) unsigned update_time[MCFD_NUM_RATES]; // ss_time() of the last good read
+  unsigned valid;                                          // bit i set if rate[i] is from the last sweep
+  alignas(MCFD_ALIGN) float tau[MCFD_INPUTS];              // effective dead time of each input, seconds
+
+  // Derived from the last sweep by mcfd_derive()
+  alignas(MCFD_ALIGN) float ratio[MCFD_INPUTS];            // rate / sum rate
+  alignas(MCFD_ALIGN) float asymmetry[MCFD_PAIRS];         // (a-b)/(a+b) of each pair
+  alignas(MCFD_ALIGN) float corrected[MCFD_INPUTS];        // non-paralysable dead time correction, Hz
+
+  MCFD_STATS stats[MCFD_NUM_RATES];                        // rolling statistics of the good readings
+} MCFD_CHANNELS;
+
+
+inline void mcfd_channels_reset(MCFD_CHANNELS* c) {
+  for (int i=0; i<MCFD_NUM_RATES; ++i) {
+    c->rate[i] = NAN;
+    c->update_time[i] = 0;
+    mcfd_stats_reset(&c->stats[i]);
+  }
+  c->valid = 0;
+  for (int i=0; i<MCFD_INPUTS; ++i)
+    c->tau[i] = 0;
+}
+
+// An input is blind for the longer of its pair's output width and dead time.  Both
+// registers are taken as nanoseconds; the dead time register starts at its 27 ns minimum.
+inline void mcfd_set_dead_time(MCFD_CHANNELS* c, const int* dead_time, const int* width) {
+  for (int i=0; i<MCFD_INPUTS; ++i)
+    c->tau[i] = std::max(dead_time[i/2], width[i/2]) * 1e-9f;
+}
+
+inline void mcfd_derive_ratio(const float* rate, float sum, float* ratio) {
+  const float inv = 1.0f / sum; // a missing sum is NaN, and so is every ratio
+  for (int i=0; i<MCFD_INPUTS; ++i)
+    ratio[i] = rate[i] * inv;
+}
+
+inline void mcfd_derive_asymmetry(const float* rate, float* asymmetry) {
+  for (int k=0; k<MCFD_PAIRS; ++k) {
+    const float a = rate[2*k], b = rate[2*k+1];
+    asymmetry[k] = (a - b) / (a + b);
+  }
+}
+
+// r / (1 - r tau); NaN once the measured rate saturates the input
+inline void mcfd_derive_corrected(const float* rate, const float* tau, float* corrected) {
+  for (int i=0; i<MCFD_INPUTS; ++i) {
+    const float live = 1.0f - rate[i] * tau[i];
+    corrected[i] = rate[i] / (live > 0 ? live : NAN); // a select on the divisor vectorises, a branch around the division does not
+  }
+}
+
+// All derived quantities of one sweep; a failed rate gives NaN in everything it feeds
+inline void mcfd_derive(MCFD_CHANNELS* c) {
+  mcfd_derive_ratio(c->rate, c->rate[MCFD_SUM_RATE], c->ratio);
+  mcfd_derive_asymmetry(c->rate, c->asymmetry);
+  mcfd_derive_corrected(c->rate, c->tau, c->corrected);
+}
+
+#endif
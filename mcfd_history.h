@@ -0,0 +1,170 @@
+/********************************************************************\
+
+  Name:         mcfd_history.h
+  Created by:   Kolby Kiesling
+
+  Contents:     Rate history at full sweep resolution, for the bursts
+                and trips the one minute MIDAS history does not show.
+                A fixed size file mapped into memory: one
+                MCFD_HISTORY_HEADER, then a ring of capacity
+                MCFD_HISTORY_RECORDs.  Record k (counting from the
+                first one ever written) sits in slot k % capacity, and
+                head is the number written so far.  Slot head % capacity
+                is the one the next record goes into, so the ring can be
+                read for records head - capacity + 1 .. head-1.  Appending is
+                a copy into the mapping and a store of head, the kernel
+                writes the pages back by itself.  The file is kept when
+                the frontend restarts and goes on where it stopped.
+                Shared by the driver and TEST/mcfd_history_read.  Does
+                not depend on MIDAS.
+
+  $Id: $
+
+\********************************************************************/
+#ifndef MCFD_HISTORY_H
+#define MCFD_HISTORY_H
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mcfd_parse.h"
+
+#define MCFD_HISTORY_MAGIC "MCFDHIS1"
+
+typedef struct {
+  char magic[8];               // MCFD_HISTORY_MAGIC, not terminated
+  unsigned header_size;        // sizeof(MCFD_HISTORY_HEADER) of the writer
+  unsigned record_size;        // sizeof(MCFD_HISTORY_RECORD) of the writer
+  unsigned long long capacity; // records in the ring
+  unsigned long long head;     // records written so far, stored after the record itself
+  unsigned long long created_ms; // wall clock ms when the file was laid out
+} MCFD_HISTORY_HEADER;
+
+typedef struct {
+  unsigned long long time_ms;  // wall clock ms at the start of the sweep
+  unsigned sequence;           // sweep number since the frontend started
+  unsigned duration_ms;        // how long the sweep took
+  unsigned valid;              // bit i set if rate[i] was read
+  unsigned reserved;
+  float rate[MCFD_NUM_RATES];  // Hz, NaN where the read failed
+} MCFD_HISTORY_RECORD;
+
+typedef struct {
+  int fd;                      // -1 when there is no history
+  size_t size;                 // of the mapping
+  MCFD_HISTORY_HEADER* header;
+  MCFD_HISTORY_RECORD* record; // the ring, right after the header
+} MCFD_HISTORY;
+
+
+// CLOCK_REALTIME is read through the vDSO on Linux, no system call
+inline unsigned long long mcfd_history_now_ms() {
+  struct timespec t;
+  clock_gettime(CLOCK_REALTIME, &t);
+  return (unsigned long long) t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+inline void mcfd_history_close(MCFD_HISTORY* h) {
+  if (h->header != NULL)
+    munmap(h->header, h->size);
+  if (h->fd >= 0)
+    close(h->fd);
+  h->fd = -1;
+  h->size = 0;
+  h->header = NULL;
+  h->record = NULL;
+}
+
+// Maps path, laying it out for capacity records unless it already is a history of that
+// capacity written with the same structures.  Read only maps an existing file as it is.
+// Returns 0, or -1 with h closed.
+inline int mcfd_history_open(MCFD_HISTORY* h, const char* path, unsigned long long capacity, bool read_only=false) {
+  h->fd = -1;
+  h->header = NULL;
+  h->record = NULL;
+  h->size = 0;
+  if (path == NULL || path[0] == 0 || (!read_only && capacity == 0))
+    return -1;
+
+  h->fd = open(path, read_only ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+  if (h->fd < 0)
+    return -1;
+  struct stat st;
+  MCFD_HISTORY_HEADER old;
+  memset(&old, 0, sizeof(old));
+  if (fstat(h->fd, &st) != 0) {
+    mcfd_history_close(h);
+    return -1;
+  }
+  if (st.st_size >= (off_t) sizeof(old) && pread(h->fd, &old, sizeof(old), 0) != (ssize_t) sizeof(old))
+    memset(&old, 0, sizeof(old));
+  bool same = memcmp(old.magic, MCFD_HISTORY_MAGIC, sizeof(old.magic)) == 0
+    && old.header_size == sizeof(MCFD_HISTORY_HEADER) && old.record_size == sizeof(MCFD_HISTORY_RECORD)
+    && st.st_size == (off_t) (sizeof(MCFD_HISTORY_HEADER) + old.capacity * sizeof(MCFD_HISTORY_RECORD));
+  if (read_only && !same) {
+    mcfd_history_close(h);
+    return -1;
+  }
+  if (read_only)
+    capacity = old.capacity;
+  bool keep = same && old.capacity == capacity;
+
+  h->size = sizeof(MCFD_HISTORY_HEADER) + capacity * sizeof(MCFD_HISTORY_RECORD);
+  if (!keep && (ftruncate(h->fd, 0) != 0 || ftruncate(h->fd, h->size) != 0)) {
+    mcfd_history_close(h);
+    return -1;
+  }
+  void* p = mmap(NULL, h->size, read_only ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, h->fd, 0);
+  if (p == MAP_FAILED) {
+    h->size = 0;
+    mcfd_history_close(h);
+    return -1;
+  }
+  h->header = (MCFD_HISTORY_HEADER*) p;
+  h->record = (MCFD_HISTORY_RECORD*) (h->header + 1);
+  if (!keep) {
+    memcpy(h->header->magic, MCFD_HISTORY_MAGIC, sizeof(h->header->magic));
+    h->header->header_size = sizeof(MCFD_HISTORY_HEADER);
+    h->header->record_size = sizeof(MCFD_HISTORY_RECORD);
+    h->header->capacity = capacity;
+    h->header->created_ms = mcfd_history_now_ms();
+    __atomic_store_n(&h->header->head, 0ull, __ATOMIC_RELEASE);
+  }
+  return 0;
+}
+
+// The record goes in first, then head moves past it, so a reader that loads head
+// sees only complete records (unless the writer has gone round the ring meanwhile,
+// see mcfd_history_get)
+inline void mcfd_history_append(MCFD_HISTORY* h, const MCFD_HISTORY_RECORD* r) {
+  if (h->header == NULL)
+    return;
+  unsigned long long head = h->header->head;
+  memcpy(&h->record[head % h->header->capacity], r, sizeof(*r));
+  __atomic_store_n(&h->header->head, head + 1, __ATOMIC_RELEASE);
+}
+
+inline unsigned long long mcfd_history_head(const MCFD_HISTORY* h) {
+  return h->header == NULL ? 0 : __atomic_load_n(&h->header->head, __ATOMIC_ACQUIRE);
+}
+
+// First record that can still be read
+inline unsigned long long mcfd_history_first(const MCFD_HISTORY* h) {
+  unsigned long long head = mcfd_history_head(h);
+  return head >= h->header->capacity ? head - h->header->capacity + 1 : 0;
+}
+
+// Copies record k; false if it is not (or not yet) in the ring, also when the writer
+// got to its slot while it was being copied
+inline bool mcfd_history_get(const MCFD_HISTORY* h, unsigned long long k, MCFD_HISTORY_RECORD* r) {
+  if (k >= mcfd_history_head(h))
+    return false;
+  memcpy(r, &h->record[k % h->header->capacity], sizeof(*r));
+  return k + h->header->capacity > mcfd_history_head(h);
+}
+
+#endif
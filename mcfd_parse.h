@@ -0,0 +1,286 @@
+/********************************************************************\
+
+  Name:         mcfd_parse.h
+  Created by:   Kolby Kiesling
+
+  Contents:     Single pass parser and reply framing helpers for
+                Mesytec MCFD16 replies.  Works directly on the received
+                bytes, no regex and no heap allocation.  Does not
+                depend on MIDAS.
+
+  $Id: $
+
+\********************************************************************/
+#ifndef MCFD_PARSE_H
+#define MCFD_PARSE_H
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#define MCFD_PROMPT "mcfd-16>"   // terminates every reply from the module
+
+#define MCFD_NUM_RATES 20        // 16 channels, 3 triggers and the sum
+#define MCFD_TRIGGER_RATE 16     // ``trigger rateN'' is reported as channel 16+N
+#define MCFD_SUM_RATE 19         // ``sum rate'' is reported as channel 19
+
+#define MCFD_PARSE_OK 1
+#define MCFD_PARSE_NO_HEADER 0   // no rate header in the text
+#define MCFD_PARSE_NO_VALUE -1   // header found, but no number followed by Hz, kHz or MHz
+#define MCFD_PARSE_NO_PROMPT -2  // rate found, but the reply was not terminated by the prompt
+
+
+typedef struct {
+  int channel;                   // 0-15 inputs, 16-18 triggers, 19 sum, -1 if not known
+  float rate;                    // Hz
+  int status;                    // MCFD_PARSE_*
+} MCFD_RATE;
+
+
+// strstr() for a buffer that is not NUL terminated
+inline const char* mcfd_find(const char* p, const char* end, const char* needle) {
+  size_t n = strlen(needle);
+  for (; p + n <= end; ++p)
+    if (*p == needle[0] && memcmp(p, needle, n) == 0)
+      return p;
+  return NULL;
+}
+
+// Matches ``literal'', an optional channel number, then ``tail''.  Returns the first
+// character after the header or NULL.
+inline const char* mcfd_match_header(const char* p, const char* end, const char* literal, const char* tail, int* number) {
+  size_t n = strlen(literal);
+  if (p + n > end || memcmp(p, literal, n) != 0)
+    return NULL;
+  p += n;
+
+  *number = -1;
+  for (; p < end && *p >= '0' && *p <= '9'; ++p)
+    *number = (*number < 0 ? 0 : *number*10) + (*p - '0');
+
+  n = strlen(tail);
+  if (p + n > end || memcmp(p, tail, n) != 0)
+    return NULL;
+  return p + n;
+}
+
+// Parse one rate line such as ``rate channel 3: 2.499 MHz'', ``trigger rate1: 25 Hz'' or
+// ``sum rate : 12.5 kHz''.  The header may sit anywhere in the buffer, which lets a whole
+// reply (echo, rate line, prompt) be handed in as is.
+inline int mcfd_parse_rate_line(const char* buf, int len, MCFD_RATE* out) {
+  const char* end = buf + len;
+  const char* p = NULL;
+  int number = -1;
+
+  out->channel = -1;
+  out->rate = -1;
+  out->status = MCFD_PARSE_NO_HEADER;
+
+  for (const char* s = buf; s < end && p == NULL; ++s) {
+    switch (*s) {
+      case 'r':
+        if ((p = mcfd_match_header(s, end, "rate channel ", ": ", &number)) != NULL)
+          out->channel = number;
+        break;
+      case 't':
+        if ((p = mcfd_match_header(s, end, "trigger rate", ": ", &number)) != NULL)
+          out->channel = number < 0 ? -1 : MCFD_TRIGGER_RATE + number;
+        break;
+      case 's':
+        if ((p = mcfd_match_header(s, end, "sum rate", " : ", &number)) != NULL)
+          out->channel = MCFD_SUM_RATE;
+        break;
+    }
+  }
+  if (p == NULL)
+    return out->status;
+  out->status = MCFD_PARSE_NO_VALUE;
+
+  while (p < end && *p == ' ')
+    ++p;
+
+  char digits[32]; // copy the number so strtod never reads past the buffer
+  int k = 0;
+  bool dot = false;
+  for (; p < end && k < (int) sizeof(digits)-1; ++p) {
+    if (*p == '.' && !dot)
+      dot = true;
+    else if (*p < '0' || *p > '9')
+      break;
+    digits[k++] = *p;
+  }
+  digits[k] = 0;
+  if (k == 0 || p >= end || *p != ' ')
+    return out->status;
+  ++p;
+
+  float scale;
+  if (p + 2 <= end && memcmp(p, "Hz", 2) == 0)
+    scale = 1;
+  else if (p + 3 <= end && memcmp(p, "kHz", 3) == 0)
+    scale = 1000;
+  else if (p + 3 <= end && memcmp(p, "MHz", 3) == 0)
+    scale = 1000000;
+  else
+    return out->status;
+
+  out->rate = (float) strtod(digits, NULL) * scale;
+  out->status = MCFD_PARSE_OK;
+  return out->status;
+}
+
+// The echo line can carry debris from an earlier prompt (``mcra 0'', ``>ra 0'' in the bus
+// logs), so only the tail of the first line has to match the command that was sent.
+inline bool mcfd_echo_matches(const char* reply, int len, const char* cmd) {
+  const char* end = reply + len;
+  size_t n = strcspn(cmd, "\r\n");
+  const char* echo = reply;
+  while (echo < end && (*echo == '\r' || *echo == '\n' || *echo == ' '))
+    ++echo;
+  const char* eol = echo;
+  while (eol < end && *eol != '\r' && *eol != '\n')
+    ++eol;
+  while (eol > echo && eol[-1] == ' ')
+    --eol;
+  return (size_t) (eol - echo) >= n && memcmp(eol - n, cmd, n) == 0;
+}
+
+inline bool mcfd_echo_matches(const char* reply, const char* cmd) {
+  return mcfd_echo_matches(reply, strlen(reply), cmd);
+}
+
+// Parse a complete reply to ``ra N'': the echo, the rate line and the trailing prompt.
+inline int mcfd_parse_rate(const char* buf, int len, MCFD_RATE* out) {
+  if (mcfd_parse_rate_line(buf, len, out) != MCFD_PARSE_OK)
+    return out->status;
+  if (mcfd_find(buf, buf + len, MCFD_PROMPT) == NULL) {
+    out->rate = -1;
+    out->status = MCFD_PARSE_NO_PROMPT;
+  }
+  return out->status;
+}
+
+// One group of the ``ds'' settings dump.  The module prints a group as ``<label>:'' and
+// the values in register order, followed by `` - <common>'', the value common mode would
+// use.  A long group goes on over unlabelled lines, the Threshold block of TEST/rs232.log
+// is ``Threshold:     0 0 0 0 0 0 0 0 '' and `` 0 0 0 0 - 9''.  A group ends with its
+// common column, or with the last line before one that does not start with a value.
+// The label has to start a line.  Stores at most max values and the common one, if there
+// is one and common is not NULL.  Returns how many values the group has (more than max if
+// it is longer), or -1 if the dump has no such group.
+inline int mcfd_parse_dump_group(const char* buf, int len, const char* label, int* values, int max, int* common=NULL) {
+  const char* end = buf + len;
+  size_t n = strlen(label);
+  const char* p = buf;
+  while ((p = mcfd_find(p, end, label)) != NULL) {
+    if ((p == buf || p[-1] == '\n') && p + n < end && p[n] == ':')
+      break;
+    p += n;
+  }
+  if (p == NULL)
+    return -1;
+  p += n+1;
+
+  int k = 0;
+  for (;;) {
+    while (p < end && *p == ' ')
+      ++p;
+    if (p < end && (*p == '\r' || *p == '\n')) {
+      // end of line: the group goes on if the next line starts with a value
+      const char* q = p;
+      while (q < end && (*q == '\r' || *q == '\n'))
+        ++q;
+      const char* v = q;
+      while (v < end && *v == ' ')
+        ++v;
+      if (v >= end || *v < '0' || *v > '9')
+        break;
+      p = q;
+      continue;
+    }
+    if (p >= end || ((*p < '0' || *p > '9') && *p != '-'))
+      break;
+    bool negative = *p == '-';
+    if (negative && (p+1 >= end || p[1] < '0' || p[1] > '9')) {
+      // `` - <common>'' closes the group
+      for (++p; p < end && *p == ' '; ++p)
+        ;
+      int v = 0;
+      for (; p < end && *p >= '0' && *p <= '9'; ++p)
+        v = v*10 + (*p - '0');
+      if (common)
+        *common = v;
+      break;
+    }
+    if (negative)
+      ++p;
+    int v = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p)
+      v = v*10 + (*p - '0');
+    if (k < max)
+      values[k] = negative ? -v : v;
+    k++;
+  }
+  return k;
+}
+
+// 64 bit FNV-1a, chain calls by passing the previous result as h
+inline unsigned long long mcfd_hash(const char* p, int len, unsigned long long h = 14695981039346656037ULL) {
+  for (int i=0; i<len; ++i)
+    h = (h ^ (unsigned char) p[i]) * 1099511628211ULL;
+  return h;
+}
+
+
+// Receive ring for one link.  read() goes straight into buf and replies are handed out
+// as views into it, so a reply is never copied on its way to the parser.  The first
+// MCFD_RING_SLACK bytes of the ring are mirrored behind its end, which keeps every frame
+// up to that length contiguous even when it wraps, without allocating.
+#define MCFD_RING_SIZE 4096      // power of two
+#define MCFD_RING_SLACK 1024     // longest frame handed out as one view, the ds dump is the longest reply
+
+typedef struct {
+  const char* data;            // points into the ring, valid until the next read on the link
+  int len;
+} MCFD_VIEW;
+
+typedef struct MCFD_RING {
+  char buf[MCFD_RING_SIZE + MCFD_RING_SLACK];
+  unsigned head, tail;         // free running, unread bytes are [head, tail)
+
+  void reset() { head = tail = 0; }
+  int used() const { return tail - head; }
+  const char* data() const { return buf + (head & (MCFD_RING_SIZE-1)); }
+
+  // Contiguous free space for the next read(), up to the physical end of the ring
+  char* write_ptr(int* n) {
+    unsigned t = tail & (MCFD_RING_SIZE-1);
+    *n = std::min<int>(MCFD_RING_SIZE - t, MCFD_RING_SIZE - used());
+    return buf + t;
+  }
+
+  void commit(int n) {
+    unsigned t = tail & (MCFD_RING_SIZE-1);
+    if (t < MCFD_RING_SLACK) // keep the mirror behind the end in step
+      memcpy(buf + MCFD_RING_SIZE + t, buf + t, std::min<int>(n, MCFD_RING_SLACK - t));
+    tail += n;
+  }
+
+  // Length of the first frame ending in pattern, or -1.  Only the first MCFD_RING_SLACK
+  // unread bytes are looked at, *scanned carries the searched length between calls.
+  int find(const char* pattern, int plen, int* scanned) const {
+    int avail = std::min(used(), MCFD_RING_SLACK);
+    const char* p = data();
+    const char* hit = mcfd_find(p + std::max(0, *scanned-plen+1), p + avail, pattern);
+    *scanned = avail;
+    return hit ? hit + plen - p : -1;
+  }
+
+  MCFD_VIEW take(int len) {
+    MCFD_VIEW view = { data(), len };
+    head += len;
+    return view;
+  }
+} MCFD_RING;
+
+#endif
@@ -0,0 +1,79 @@
+/********************************************************************\
+
+  Name:         mcfd_rtt.h
+  Created by:   Kolby Kiesling
+
+  Contents:     Round trip times of one class of MCFD16 commands and
+                the reply deadline learned from them: a multiple of a
+                high percentile of the recent round trips, between a
+                floor and a ceiling.  Every timeout in a row doubles
+                the deadline until a reply comes back in time, so a
+                module that slows down is followed within a few
+                commands.  Does not depend on MIDAS.
+
+  $Id: $
+
+\********************************************************************/
+#ifndef MCFD_RTT_H
+#define MCFD_RTT_H
+
+#include <algorithm>
+
+#define MCFD_RTT_SAMPLES 64      // recent round trips kept per class
+#define MCFD_RTT_MIN_SAMPLES 8   // the ceiling is used until this many were seen
+#define MCFD_RTT_PERCENTILE 0.99
+#define MCFD_RTT_FACTOR 2        // deadline = factor * percentile + slack
+#define MCFD_RTT_SLACK 5         // milliseconds, covers the millisecond clock and scheduling
+
+typedef struct {
+  int sample[MCFD_RTT_SAMPLES]; // ms, round trip k sits at k % MCFD_RTT_SAMPLES
+  unsigned long count;         // round trips so far
+  unsigned long timeouts;      // replies that missed the deadline
+  int backoff;                 // timeouts in a row
+  int floor, ceiling;          // ms
+  int deadline;                // ms, what the next command of the class gets
+} MCFD_RTT;
+
+
+inline int mcfd_rtt_percentile(const MCFD_RTT* r, double q) {
+  int n = r->count < MCFD_RTT_SAMPLES ? (int) r->count : MCFD_RTT_SAMPLES;
+  if (n == 0)
+    return 0;
+  int x[MCFD_RTT_SAMPLES];
+  std::copy(r->sample, r->sample + n, x);
+  int k = std::min(n-1, (int) (q * n));
+  std::nth_element(x, x + k, x + n);
+  return x[k];
+}
+
+inline void mcfd_rtt_update(MCFD_RTT* r) {
+  long d = r->ceiling;
+  if (r->count >= MCFD_RTT_MIN_SAMPLES)
+    d = std::max((long) r->floor, (long) MCFD_RTT_FACTOR * mcfd_rtt_percentile(r, MCFD_RTT_PERCENTILE) + MCFD_RTT_SLACK);
+  for (int i=0; i<r->backoff && d < r->ceiling; ++i)
+    d *= 2;
+  r->deadline = (int) std::min(d, (long) r->ceiling);
+}
+
+inline void mcfd_rtt_reset(MCFD_RTT* r, int floor, int ceiling) {
+  r->count = r->timeouts = 0;
+  r->backoff = 0;
+  r->floor = floor;
+  r->ceiling = std::max(floor, ceiling);
+  mcfd_rtt_update(r);
+}
+
+inline void mcfd_rtt_add(MCFD_RTT* r, int ms) {
+  r->sample[r->count % MCFD_RTT_SAMPLES] = ms;
+  r->count++;
+  r->backoff = 0;
+  mcfd_rtt_update(r);
+}
+
+inline void mcfd_rtt_timeout(MCFD_RTT* r) {
+  r->timeouts++;
+  r->backoff++;
+  mcfd_rtt_update(r);
+}
+
+#endif
@@ -0,0 +1,160 @@
+/********************************************************************\
+
+  Name:         mcfd_scan.h
+  Created by:   Kolby Kiesling
+
+  Contents:     Parameter scan description and the binary file the
+                driver writes while it runs one.  Shared by the driver
+                and TEST/mcfd_scan_read.  Does not depend on MIDAS.
+
+                A description has one dimension per ``;'', the first
+                one is the outermost loop:
+
+                  <field> <channels> <values> [; ...]
+
+                field     a DD settings array or value, e.g. set_fraction
+                channels  all, 3, 0-7 or 0,2,4; every listed index
+                          gets the same value at a point
+                values    start:stop:step (stop included) or 1,3,10
+
+                e.g. ``set_fraction all 20,40 ; set_delay_line all 1:5:1''
+
+                The file is one MCFD_SCAN_HEADER and one MCFD_SCAN_RECORD
+                per point, in point order.  The header lists the values of
+                every dimension, so point p is the mixed radix number of
+                its value indices (last dimension fastest) and its record
+                sits at header_size + p * record_size.
+
+  $Id: $
+
+\********************************************************************/
+#ifndef MCFD_SCAN_H
+#define MCFD_SCAN_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "mcfd_parse.h"
+
+#define MCFD_SCAN_MAGIC "MCFDSCN1"
+#define MCFD_SCAN_MAX_DIMS 4
+#define MCFD_SCAN_MAX_VALUES 64  // per dimension
+
+typedef struct {
+  char field[32];              // DD settings member
+  unsigned channels;           // bit i: array index i takes the value
+  int n;                       // values
+  int value[MCFD_SCAN_MAX_VALUES];
+} MCFD_SCAN_DIM;
+
+typedef struct {
+  char magic[8];               // MCFD_SCAN_MAGIC, not terminated
+  unsigned header_size;        // sizeof(MCFD_SCAN_HEADER) of the writer
+  unsigned record_size;        // sizeof(MCFD_SCAN_RECORD) of the writer
+  unsigned start_time;         // ss_time() at the start of the scan
+  unsigned dwell_ms;
+  int ndims;
+  unsigned npoints;            // planned; an aborted scan has fewer records
+  MCFD_SCAN_DIM dim[MCFD_SCAN_MAX_DIMS];
+  char description[256];
+} MCFD_SCAN_HEADER;
+
+typedef struct {
+  unsigned point;
+  unsigned time;               // ss_time() of the sweep
+  unsigned valid;              // bit i set if rate[i] was read
+  int value[MCFD_SCAN_MAX_DIMS];
+  float rate[MCFD_NUM_RATES];  // Hz, one sweep after the dwell time
+} MCFD_SCAN_RECORD;
+
+
+// ``all'', ``3'', ``0-7'' or ``0,2,4'' into a bit mask of indices below count, 0 on error
+inline unsigned mcfd_scan_channels(const char* s, int count) {
+  unsigned mask = 0;
+  if (strcmp(s, "all") == 0)
+    return count >= 32 ? ~0u : (1u << count) - 1;
+  while (*s) {
+    char* end;
+    long a = strtol(s, &end, 10), b = a;
+    if (end == s)
+      return 0;
+    if (*end == '-') {
+      s = end+1;
+      b = strtol(s, &end, 10);
+      if (end == s)
+        return 0;
+    }
+    if (a < 0 || b < a || b >= count)
+      return 0;
+    for (long i=a; i<=b; ++i)
+      mask |= 1u << i;
+    s = *end == ',' ? end+1 : end;
+    if (*end && *end != ',')
+      return 0;
+  }
+  return mask;
+}
+
+// ``start:stop:step'' or ``1,3,10'' into dim->value, false on error
+inline bool mcfd_scan_values(const char* s, MCFD_SCAN_DIM* dim) {
+  int start, stop, step;
+  dim->n = 0;
+  if (sscanf(s, "%d:%d:%d", &start, &stop, &step) == 3) {
+    if (step == 0 || (stop - start) / step < 0)
+      return false;
+    for (int v=start; step > 0 ? v <= stop : v >= stop; v += step) {
+      if (dim->n >= MCFD_SCAN_MAX_VALUES)
+        return false;
+      dim->value[dim->n++] = v;
+    }
+    return dim->n > 0;
+  }
+  while (*s) {
+    char* end;
+    long v = strtol(s, &end, 10);
+    if (end == s || dim->n >= MCFD_SCAN_MAX_VALUES || (*end && *end != ','))
+      return false;
+    dim->value[dim->n++] = (int) v;
+    s = *end ? end+1 : end;
+  }
+  return dim->n > 0;
+}
+
+// Fill the dimensions of h from a description.  count(field) gives the array length of a
+// settings member, 0 if there is no such member.  Returns NULL or what is wrong.
+inline const char* mcfd_parse_scan(const char* description, MCFD_SCAN_HEADER* h, int (*count)(const char* field)) {
+  char copy[256], field[sizeof(h->dim[0].field)], channels[64], values[128];
+  strncpy(copy, description, sizeof(copy)-1);
+  copy[sizeof(copy)-1] = 0;
+  strncpy(h->description, copy, sizeof(h->description));
+
+  h->ndims = 0;
+  h->npoints = 1;
+  for (char* part = strtok(copy, ";"); part != NULL; part = strtok(NULL, ";")) {
+    if (sscanf(part, "%31s %63s %127s", field, channels, values) != 3) // no settings member is longer than field
+      return "expected <field> <channels> <values>";
+    if (h->ndims >= MCFD_SCAN_MAX_DIMS)
+      return "too many dimensions";
+    MCFD_SCAN_DIM* dim = &h->dim[h->ndims];
+    int n = count(field);
+    if (n <= 0)
+      return "unknown field";
+    memcpy(dim->field, field, sizeof(dim->field));
+    if ((dim->channels = mcfd_scan_channels(channels, n)) == 0)
+      return "bad channel list";
+    if (!mcfd_scan_values(values, dim))
+      return "bad value list";
+    h->npoints *= dim->n;
+    h->ndims++;
+  }
+  return h->ndims > 0 ? NULL : "empty scan";
+}
+
+// Value index of dimension d at point p
+inline int mcfd_scan_index(const MCFD_SCAN_HEADER* h, unsigned p, int d) {
+  for (int k=h->ndims-1; k>d; --k)
+    p /= h->dim[k].n;
+  return p % h->dim[d].n;
+}
+
+#endif
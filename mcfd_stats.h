@@ -0,0 +1,111 @@
+/********************************************************************\
+
+  Name:         mcfd_stats.h
+  Created by:   Kolby Kiesling
+
+  Contents:     Rolling statistics over the last MCFD_STAT_WINDOW
+                samples of one rate: mean, variance, min, max and an
+                EWMA.  Every update is O(1) (amortised) on fixed
+                storage, like the tmp_frq windows of the python
+                tools.  Does not depend on MIDAS.
+
+  $Id: $
+
+\********************************************************************/
+#ifndef MCFD_STATS_H
+#define MCFD_STATS_H
+
+#define MCFD_STAT_WINDOW 10                            // samples, same as the python tools
+#define MCFD_STAT_EWMA_ALPHA (2.0/(MCFD_STAT_WINDOW+1)) // same centre of mass as the window
+
+typedef struct {
+  double x[MCFD_STAT_WINDOW];  // last samples, sample k sits at k % MCFD_STAT_WINDOW
+  unsigned long count;         // samples so far
+  int n;                       // samples in the window
+  double mean, m2;             // Welford sums over the window
+  double ewma;
+  // Monotonic wedges: sample numbers that can still become the window's min or max,
+  // oldest first, their values increasing (min) or decreasing (max)
+  unsigned long minq[MCFD_STAT_WINDOW], maxq[MCFD_STAT_WINDOW];
+  int min_head, min_len, max_head, max_len;
+} MCFD_STATS;
+
+
+inline void mcfd_stats_reset(MCFD_STATS* s) {
+  s->count = 0;
+  s->n = 0;
+  s->mean = s->m2 = s->ewma = 0;
+  s->min_head = s->min_len = s->max_head = s->max_len = 0;
+}
+
+inline double mcfd_stats_at(const MCFD_STATS* s, unsigned long k) {
+  return s->x[k % MCFD_STAT_WINDOW];
+}
+
+// Drop sample numbers that left the window from the front, then everything the new
+// sample beats from the back.  Each sample is pushed and popped once, O(1) amortised.
+inline void mcfd_wedge_push(const MCFD_STATS* s, unsigned long* q, int* head, int* len, bool is_min) {
+  unsigned long k = s->count;
+  double v = mcfd_stats_at(s, k);
+  while (*len > 0 && q[*head] + MCFD_STAT_WINDOW <= k) {
+    *head = (*head + 1) % MCFD_STAT_WINDOW;
+    (*len)--;
+  }
+  while (*len > 0) {
+    double back = mcfd_stats_at(s, q[(*head + *len - 1) % MCFD_STAT_WINDOW]);
+    if (is_min ? back < v : back > v)
+      break;
+    (*len)--;
+  }
+  q[(*head + *len) % MCFD_STAT_WINDOW] = k;
+  (*len)++;
+}
+
+inline void mcfd_stats_add(MCFD_STATS* s, double v) {
+  int slot = s->count % MCFD_STAT_WINDOW;
+  if (s->n < MCFD_STAT_WINDOW) { // window still filling, plain Welford
+    s->n++;
+    double d = v - s->mean;
+    s->mean += d / s->n;
+    s->m2 += d * (v - s->mean);
+  }
+  else { // replace the oldest sample
+    double old = s->x[slot];
+    double mean = s->mean + (v - old) / MCFD_STAT_WINDOW;
+    s->m2 += (v - old) * (v - mean + old - s->mean);
+    if (s->m2 < 0)
+      s->m2 = 0; // rounding
+    s->mean = mean;
+  }
+  s->ewma = s->count == 0 ? v : s->ewma + MCFD_STAT_EWMA_ALPHA * (v - s->ewma);
+  s->x[slot] = v;
+
+  if (slot == MCFD_STAT_WINDOW-1 && s->n == MCFD_STAT_WINDOW) { // once per window, drop the rounding the updates collected
+    double mean = 0, m2 = 0;
+    for (int i=0; i<MCFD_STAT_WINDOW; ++i)
+      mean += s->x[i];
+    mean /= MCFD_STAT_WINDOW;
+    for (int i=0; i<MCFD_STAT_WINDOW; ++i)
+      m2 += (s->x[i] - mean) * (s->x[i] - mean);
+    s->mean = mean;
+    s->m2 = m2;
+  }
+
+  mcfd_wedge_push(s, s->minq, &s->min_head, &s->min_len, true);
+  mcfd_wedge_push(s, s->maxq, &s->max_head, &s->max_len, false);
+  s->count++;
+}
+
+inline double mcfd_stats_variance(const MCFD_STATS* s) {
+  return s->n > 1 ? s->m2 / (s->n - 1) : 0;
+}
+
+inline double mcfd_stats_min(const MCFD_STATS* s) {
+  return mcfd_stats_at(s, s->minq[s->min_head]);
+}
+
+inline double mcfd_stats_max(const MCFD_STATS* s) {
+  return mcfd_stats_at(s, s->maxq[s->max_head]);
+}
+
+#endif
@@ -0,0 +1,419 @@
+/********************************************************************\
+
+  Name:         mcfd_transport.h
+  Created by:   Kolby Kiesling
+
+  Contents:     Transport policies for the MCFD16 device driver.
+                dd_mcfd16.cxx is compiled against exactly one of them,
+                chosen with -DMCFD_TRANSPORT=..., so every call on the
+                readout path is a plain member call the compiler can
+                inline instead of a varargs bus driver call:
+
+                  MCFD_RS232   serial port opened by the driver itself
+                  MCFD_TCPIP   module behind a terminal server
+                  MCFD_BUS     any MIDAS bus driver through its entry
+                               function, e.g. ../replay.cxx
+
+                All three answer frame() the way rs232_gets would: the
+                length once the pattern was received, otherwise 0 at the
+                deadline with whatever did arrive.  The frame is a view
+                into the receive ring, valid until the next frame().
+
+  $Id: $
+
+\********************************************************************/
+#ifndef MCFD_TRANSPORT_H
+#define MCFD_TRANSPORT_H
+
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+#include "midas.h"
+#include "mcfd_parse.h"
+
+
+// Same record layout the MIDAS rs232 and tcpip bus drivers write when Debug is set, so a
+// capture taken with either transport can be fed back through ../replay.cxx.
+inline void mcfd_log(const char* file, const char* format, ...) {
+  FILE* f = fopen(file, "a");
+  if (f == NULL)
+    return;
+  va_list argptr;
+  va_start(argptr, format);
+  vfprintf(f, format, argptr);
+  va_end(argptr);
+  fclose(f);
+}
+
+
+// Reader/writer shared by the two file descriptor transports.  One read() takes everything
+// the kernel has into the ring; bytes after the pattern (the start of the next pipelined
+// reply) stay there for the next call.
+typedef struct MCFD_FD_LINK {
+  int fd = -1;
+  bool socket;                 // send() with MSG_NOSIGNAL instead of write()
+  int debug;
+  const char* log;             // Debug log file
+  MCFD_RING rx;
+
+  void open_link(int handle, bool is_socket, int debug_level, const char* log_file) {
+    fd = handle;
+    socket = is_socket;
+    debug = debug_level;
+    log = log_file;
+    rx.reset();
+  }
+
+  int exit() {
+    if (fd >= 0)
+      close(fd);
+    fd = -1;
+    return SUCCESS;
+  }
+
+  // Throw away whatever is pending, including a reply still on its way: stops once the
+  // line has been quiet for quiet ms, or after millisec if it never is.  Returns the
+  // number of bytes dropped.
+  int flush(int quiet, int millisec) {
+    DWORD start = ss_millitime();
+    int dropped = rx.used();
+    char buf[256];
+    rx.reset();
+    for (;;) {
+      int remaining = millisec - (int) (ss_millitime() - start);
+      struct pollfd p = { fd, POLLIN, 0 };
+      if (remaining <= 0 || poll(&p, 1, std::min(quiet, remaining)) <= 0)
+        break;
+      int n = read(fd, buf, sizeof(buf));
+      if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        continue;
+      if (n <= 0)
+        break;
+      dropped += n;
+    }
+    if (debug && dropped)
+      mcfd_log(log, "flush: %d bytes\n", dropped);
+    return dropped;
+  }
+
+  int puts(const char* str) {
+    int len = strlen(str);
+    for (int done=0; done < len; ) {
+      int n = socket ? send(fd, str+done, len-done, MSG_NOSIGNAL) : write(fd, str+done, len-done);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return -1;
+      done += n;
+    }
+    if (debug)
+      mcfd_log(log, "puts: %s\n", str);
+    return len;
+  }
+
+  int frame(MCFD_VIEW* view, const char* pattern, int millisec) {
+    DWORD start = ss_millitime();
+    int plen = strlen(pattern);
+    int scanned = 0;
+    int len;
+
+    while ((len = rx.find(pattern, plen, &scanned)) < 0 && scanned < MCFD_RING_SLACK) {
+      int remaining = millisec - (int) (ss_millitime() - start);
+      struct pollfd p = { fd, POLLIN, 0 };
+      if (remaining <= 0 || poll(&p, 1, remaining) <= 0)
+        break;
+      int space;
+      char* dst = rx.write_ptr(&space);
+      int n = read(fd, dst, space);
+      if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        continue;
+      if (n <= 0)
+        break; // error, or the peer closed the connection
+      rx.commit(n);
+#ifdef TCP_QUICKACK
+      if (socket) { // ACK now, a terminal server without TCP_NODELAY holds the rest of the reply until it sees one
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one));
+      }
+#endif
+    }
+
+    *view = rx.take(len >= 0 ? len : std::min(rx.used(), MCFD_RING_SLACK));
+    if (debug)
+      mcfd_log(log, "getstr %s: %.*s\n", pattern, view->len, view->data);
+    return len >= 0 ? len : 0; // 0: pattern not seen before the deadline
+  }
+
+  // Only a serial port has a line rate of its own, see MCFD_RS232
+  int line_rate() { return 0; }
+  int set_baud(int baud) { return -1; }
+} MCFD_FD_LINK;
+
+
+//---- rs232 ---------------------------------------------------------
+
+// Same keys as the MIDAS rs232 bus driver, so an existing BD record keeps its values
+#define MCFD_RS232_SETTINGS_STR "\
+Device = STRING : [32] /dev/ttyS0\n\
+Baud = INT : 9600\n\
+Parity = CHAR : N\n\
+Data Bit = INT : 8\n\
+Stop Bit = INT : 1\n\
+Flow control = INT : 0\n\
+Low Latency = BOOL : y\n\
+Debug = INT : 0\n\
+"
+
+typedef struct {
+  char device[32];
+  INT baud;
+  char parity;
+  INT data_bit;
+  INT stop_bit;
+  INT flow_control;            // 0: none, 1: RTS/CTS, 2: XON/XOFF
+  BOOL low_latency;            // ask the UART driver not to batch received bytes
+  INT debug;
+} MCFD_RS232_SETTINGS;
+
+inline bool mcfd_baud_supported(int baud) {
+  static const int rates[] = { 1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200, 230400 };
+  return std::find(rates, rates + sizeof(rates)/sizeof(rates[0]), baud) != rates + sizeof(rates)/sizeof(rates[0]);
+}
+
+inline speed_t mcfd_baud(int baud) {
+  switch (baud) {
+    case 1200: return B1200;
+    case 2400: return B2400;
+    case 4800: return B4800;
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+  }
+  cm_msg(MERROR, "mcfd_baud", "Baud rate %d is not supported, using 9600", baud);
+  return B9600;
+}
+
+typedef struct MCFD_RS232 : MCFD_FD_LINK {
+  MCFD_RS232_SETTINGS settings;
+
+  int init(HNDLE hkey, INT (*bd)(INT cmd, ...)) {
+    HNDLE hDB, hkeybd;
+    cm_get_experiment_database(&hDB, NULL);
+    int status = db_create_record(hDB, hkey, "BD", MCFD_RS232_SETTINGS_STR);
+    if (status != DB_SUCCESS)
+      return FE_ERR_ODB;
+    db_find_key(hDB, hkey, "BD", &hkeybd);
+    int size = sizeof(settings);
+    status = db_get_record(hDB, hkeybd, &settings, &size, 0);
+    if (status != DB_SUCCESS)
+      return FE_ERR_ODB;
+
+    int handle = open(settings.device, O_RDWR | O_NOCTTY);
+    if (handle < 0) {
+      cm_msg(MERROR, "mcfd_rs232_init", "Cannot open %s: %s", settings.device, strerror(errno));
+      return FE_ERR_HW;
+    }
+    open_link(handle, false, settings.debug, "rs232.log");
+
+    // Raw mode with VMIN = VTIME = 0: read() never blocks and returns whatever the driver
+    // has, poll() does all the waiting.  This is what lets one read() take a whole reply.
+    struct termios tio;
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, mcfd_baud(settings.baud));
+    cfsetospeed(&tio, mcfd_baud(settings.baud));
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS);
+    tio.c_cflag |= settings.data_bit == 7 ? CS7 : CS8;
+    if (settings.parity == 'E' || settings.parity == 'e')
+      tio.c_cflag |= PARENB;
+    if (settings.parity == 'O' || settings.parity == 'o')
+      tio.c_cflag |= PARENB | PARODD;
+    if (settings.stop_bit == 2)
+      tio.c_cflag |= CSTOPB;
+    if (settings.flow_control == 1)
+      tio.c_cflag |= CRTSCTS;
+    if (settings.flow_control == 2)
+      tio.c_iflag |= IXON | IXOFF;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &tio) < 0) {
+      cm_msg(MERROR, "mcfd_rs232_init", "Cannot configure %s: %s", settings.device, strerror(errno));
+      exit();
+      return FE_ERR_HW;
+    }
+
+#ifdef __linux__
+    // Without this the 8250 and most USB adapters hold received bytes for up to a tick
+    struct serial_struct serial;
+    if (settings.low_latency && ioctl(fd, TIOCGSERIAL, &serial) == 0) {
+      serial.flags |= ASYNC_LOW_LATENCY;
+      ioctl(fd, TIOCSSERIAL, &serial); // not every driver supports it, nothing to do if not
+    }
+#endif
+    tcflush(fd, TCIOFLUSH);
+    return SUCCESS;
+  }
+
+  int line_rate() { return settings.baud; }
+
+  // Change the port's rate once what was written has left it, and drop what arrived at
+  // the old one.  The module has to be told separately.
+  int set_baud(int baud) {
+    struct termios tio;
+    if (!mcfd_baud_supported(baud) || tcgetattr(fd, &tio) < 0)
+      return -1;
+    cfsetispeed(&tio, mcfd_baud(baud));
+    cfsetospeed(&tio, mcfd_baud(baud));
+    if (tcsetattr(fd, TCSADRAIN, &tio) < 0)
+      return -1;
+    tcflush(fd, TCIFLUSH);
+    rx.reset();
+    settings.baud = baud;
+    return SUCCESS;
+  }
+} MCFD_RS232;
+
+
+//---- tcpip ---------------------------------------------------------
+
+// Same keys as the MIDAS tcpip bus driver
+#define MCFD_TCPIP_SETTINGS_STR "\
+Host = STRING : [256] \n\
+Port = INT : 23\n\
+Debug = INT : 0\n\
+"
+
+typedef struct {
+  char host[256];
+  INT port;
+  INT debug;
+} MCFD_TCPIP_SETTINGS;
+
+typedef struct MCFD_TCPIP : MCFD_FD_LINK {
+  MCFD_TCPIP_SETTINGS settings;
+
+  int init(HNDLE hkey, INT (*bd)(INT cmd, ...)) {
+    HNDLE hDB, hkeybd;
+    cm_get_experiment_database(&hDB, NULL);
+    int status = db_create_record(hDB, hkey, "BD", MCFD_TCPIP_SETTINGS_STR);
+    if (status != DB_SUCCESS)
+      return FE_ERR_ODB;
+    db_find_key(hDB, hkey, "BD", &hkeybd);
+    int size = sizeof(settings);
+    status = db_get_record(hDB, hkeybd, &settings, &size, 0);
+    if (status != DB_SUCCESS)
+      return FE_ERR_ODB;
+
+    char port[16];
+    snprintf(port, sizeof(port), "%d", settings.port);
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(settings.host, port, &hints, &res) != 0) {
+      cm_msg(MERROR, "mcfd_tcpip_init", "Cannot resolve host \"%s\"", settings.host);
+      return FE_ERR_HW;
+    }
+    int handle = -1;
+    for (struct addrinfo* a = res; a != NULL && handle < 0; a = a->ai_next) {
+      handle = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+      if (handle >= 0 && connect(handle, a->ai_addr, a->ai_addrlen) < 0) {
+        close(handle);
+        handle = -1;
+      }
+    }
+    freeaddrinfo(res);
+    if (handle < 0) {
+      cm_msg(MERROR, "mcfd_tcpip_init", "Cannot connect to %s:%d", settings.host, settings.port);
+      return FE_ERR_HW;
+    }
+
+    // Commands are a few bytes each and every one waits for its reply, Nagle would hold
+    // each of them back for the previous ACK
+    int one = 1;
+    setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    open_link(handle, true, settings.debug, "tcpip.log");
+    return SUCCESS;
+  }
+} MCFD_TCPIP;
+
+
+//---- MIDAS bus driver ----------------------------------------------
+
+// Goes through the bus driver from the DEVICE_DRIVER table, for buses this file does
+// not know about and for ../replay.cxx
+typedef struct MCFD_BUS {
+  INT (*bd)(INT cmd, ...) = NULL; // bus driver entry function
+  void *bd_info = NULL;        // private info of bus driver, NULL unless its CMD_INIT succeeded
+  char reply[MCFD_RING_SLACK];
+
+  int init(HNDLE hkey, INT (*bus)(INT cmd, ...)) {
+    bd = bus;
+    if (bd == NULL) {
+      cm_msg(MERROR, "mcfd_bus_init", "Driver built for a MIDAS bus driver, but the device has none");
+      return FE_ERR_HW;
+    }
+    int status = bd(CMD_INIT, hkey, &bd_info);
+    if (status != SUCCESS)
+      bd_info = NULL; // the bus driver is in an unknown state, leave it alone
+    return status;
+  }
+
+  int exit() {
+    if (bd_info == NULL)
+      return SUCCESS;
+    int status = bd(CMD_EXIT, bd_info);
+    bd_info = NULL;
+    return status;
+  }
+
+  int puts(const char* str) {
+    return bd(CMD_PUTS, bd_info, str);
+  }
+
+  int flush(int quiet, int millisec) {
+    DWORD start = ss_millitime();
+    int dropped=0, n;
+    while ((int) (ss_millitime() - start) < millisec &&
+           (n = bd(CMD_READ, bd_info, reply, sizeof(reply), quiet)) > 0)
+      dropped += n;
+    return dropped;
+  }
+
+  // The bus driver copies into reply, a view of that is the best this path can do
+  int frame(MCFD_VIEW* view, const char* pattern, int millisec) {
+    int len = bd(CMD_GETS, bd_info, reply, sizeof(reply), pattern, millisec);
+    view->data = reply;
+    view->len = strlen(reply);
+    return len > 0 ? len : 0;
+  }
+
+  // The bus driver owns the line settings
+  int line_rate() { return 0; }
+  int set_baud(int baud) { return -1; }
+} MCFD_BUS;
+
+
+#ifndef MCFD_TRANSPORT
+#define MCFD_TRANSPORT MCFD_RS232
+#endif
+
+#endif
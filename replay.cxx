@@ -0,0 +1,350 @@
+//********************************************************************
+//
+//  Name:         replay.cxx
+//  Created by:   Kolby Kiesling
+//
+//  Contents:     Transcript replay bus driver.  Drop-in replacement for
+//                rs232 in the DEVICE_DRIVER list that answers BD_PUTS /
+//                BD_GETS from a recorded bus log (the rs232 driver's
+//                Debug output, e.g. TEST/rs232.log) so init, apply and
+//                readout can be run without a module, in a loop.
+//
+//                Timing = 0 replays as fast as possible, Timing = 1
+//                releases the recorded bytes at the Baud rate and lets
+//                a read without its pattern wait out its timeout like
+//                the real port does.
+//
+//  $Id: $
+//
+//********************************************************************
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdarg>
+#include <cstring>
+#include <iostream>
+#include "midas.h"
+#include "replay.h"
+using namespace std;
+
+
+#define REPLAY_SETTINGS_STR "\
+Transcript = STRING : [256] rs232.log\n\
+Timing = INT : 0\n\
+Baud = INT : 9600\n\
+Prompt = STRING : [32] mcfd-16>\n\
+Debug = INT : 0\n\
+"
+
+typedef struct {
+  char transcript[256];        // rs232 Debug log to answer from
+  int timing;                  // 0: as fast as possible, 1: original (wire) timing
+  int baud;                    // line rate used for the wire timing
+  char prompt[32];             // appended to replies that were logged without it
+  int debug;
+} REPLAY_SETTINGS;
+
+typedef struct {
+  string cmd;                  // what was written
+  string reply;                // everything read back before the next write
+} REPLAY_EXCHANGE;
+
+typedef struct {
+  REPLAY_SETTINGS settings;
+  vector<REPLAY_EXCHANGE> exchanges;
+  size_t cursor;               // next exchange to try
+  string rx;                   // reply bytes not yet handed out
+  size_t rx_pos;
+  DWORD rx_start;              // ss_millitime() when the current reply started ``arriving''
+  size_t rx_released;          // bytes of rx already handed out before rx_start
+  int matched, unmatched, wraps;
+} REPLAY_INFO;
+
+
+// Split the rs232 log into exchanges.  The rs232 driver writes ``puts: <str>\n'' and
+// ``getstr <pattern>: <str>\n''; the pattern can contain a newline, so a record only ends
+// where the next one starts.  Reads that ended on a timeout are not logged at all, which
+// is how most replies lost their prompt; it is put back from the settings.
+int replay_load(REPLAY_INFO* info) {
+  FILE* f = fopen(info->settings.transcript, "rb");
+  if (f == NULL) {
+    cm_msg(MERROR, "replay_load", "Cannot open transcript \"%s\"", info->settings.transcript);
+    return FE_ERR_HW;
+  }
+  string s;
+  char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    s.append(buf, n);
+  fclose(f);
+
+  info->exchanges.clear();
+  size_t pos = 0;
+  while (pos < s.size()) {
+    bool is_puts = s.compare(pos, 6, "puts: ") == 0;
+    size_t start = is_puts ? pos+6 : s.find(": ", pos);
+    if (start == string::npos)
+      break;
+    if (!is_puts)
+      start += 2;
+
+    size_t next = min(s.find("\nputs: ", start), s.find("\ngetstr ", start));
+    size_t stop = next == string::npos ? s.size() : next;
+    string payload = s.substr(start, stop-start); // the logger's own newline is the one before next
+    if (next == string::npos && !payload.empty() && payload[payload.size()-1] == '\n')
+      payload.erase(payload.size()-1);
+
+    if (is_puts) {
+      REPLAY_EXCHANGE ex;
+      ex.cmd = payload;
+      info->exchanges.push_back(ex);
+    }
+    else if (!info->exchanges.empty())
+      info->exchanges.back().reply += payload;
+    pos = next == string::npos ? s.size() : next+1;
+  }
+
+  const char* prompt = info->settings.prompt;
+  for (size_t i=0; i<info->exchanges.size(); ++i) {
+    string& reply = info->exchanges[i].reply;
+    if (prompt[0] && !reply.empty() && reply.find(prompt) == string::npos)
+      reply += prompt;
+  }
+
+  printf("replay: %d exchanges from \"%s\"\n", (int) info->exchanges.size(), info->settings.transcript);
+  return info->exchanges.empty() ? FE_ERR_HW : SUCCESS;
+}
+
+// Commands are compared without their line ending
+bool replay_same_cmd(const string& a, const char* b, size_t n) {
+  size_t na = a.find_last_not_of("\r\n");
+  na = na == string::npos ? 0 : na+1;
+  while (n > 0 && (b[n-1] == '\r' || b[n-1] == '\n'))
+    n--;
+  return na == n && a.compare(0, n, b, n) == 0;
+}
+
+// Bytes of the current reply that have ``arrived'' by now
+size_t replay_available(REPLAY_INFO* info) {
+  size_t left = info->rx.size() - info->rx_pos;
+  if (info->settings.timing == 0 || info->settings.baud <= 0)
+    return left;
+  size_t wire = (size_t) ((ss_millitime() - info->rx_start) * (double) info->settings.baud / 10000.0);
+  size_t arrived = wire > info->rx_released ? wire - info->rx_released : 0;
+  return min(left, arrived);
+}
+
+//---- standard bus driver routines ----------------------------------
+
+int replay_init(HNDLE hkey, void** pinfo) {
+  HNDLE hDB, hkeybd;
+  REPLAY_INFO* info = new REPLAY_INFO;
+  *pinfo = info;
+
+  cm_get_experiment_database(&hDB, NULL);
+  int status = db_create_record(hDB, hkey, "BD", REPLAY_SETTINGS_STR);
+  if (status != DB_SUCCESS)
+    return FE_ERR_ODB;
+  db_find_key(hDB, hkey, "BD", &hkeybd);
+  int size = sizeof(info->settings);
+  status = db_get_record(hDB, hkeybd, &info->settings, &size, 0);
+  if (status != DB_SUCCESS)
+    return FE_ERR_ODB;
+
+  info->cursor = 0;
+  info->rx_pos = 0;
+  info->rx_start = ss_millitime();
+  info->rx_released = 0;
+  info->matched = info->unmatched = info->wraps = 0;
+  return replay_load(info);
+}
+
+int replay_exit(REPLAY_INFO* info) {
+  printf("replay: %d commands answered, %d without a recorded answer, %d pass(es) through the transcript\n",
+         info->matched, info->unmatched, info->wraps+1);
+  delete info;
+  return SUCCESS;
+}
+
+// A reply is appended to what is still arriving, or starts arriving now if the line is idle
+void replay_start_reply(REPLAY_INFO* info) {
+  if (info->rx_pos >= info->rx.size() || replay_available(info) == 0) {
+    info->rx.erase(0, info->rx_pos);
+    info->rx_pos = 0;
+    info->rx_start = ss_millitime();
+    info->rx_released = 0;
+  }
+}
+
+// A write looks for the next recorded exchange with the same command, wrapping around
+// the end of the transcript so a long run can loop over a short capture.
+int replay_puts(REPLAY_INFO* info, const char* str, size_t len) {
+  if (info->settings.debug)
+    printf("replay puts: %.*s\n", (int) len, str);
+
+  size_t n = info->exchanges.size();
+  for (size_t k=0; k<n; ++k) {
+    size_t i = (info->cursor + k) % n;
+    if (!replay_same_cmd(info->exchanges[i].cmd, str, len))
+      continue;
+    if (i < info->cursor)
+      info->wraps++;
+    info->cursor = i+1;
+
+    replay_start_reply(info);
+    info->rx += info->exchanges[i].reply;
+    info->matched++;
+    return (int) len;
+  }
+
+  if (replay_same_cmd("", str, len)) { // an empty line only brings the prompt back, recorded or not
+    replay_start_reply(info);
+    info->rx += info->settings.prompt;
+    return (int) len;
+  }
+  info->unmatched++; // nothing recorded for this command, the read will time out
+  return (int) len;
+}
+
+// Same contract as rs232_gets: the length when the pattern was seen, otherwise 0 after
+// the timeout with whatever did arrive left in str.
+int replay_gets(REPLAY_INFO* info, char* str, int size, const char* pattern, int millisec) {
+  DWORD start = ss_millitime();
+  int l = 0;
+  memset(str, 0, size);
+
+  while (l < size-1) {
+    size_t avail = replay_available(info);
+    if (avail == 0) {
+      if (info->settings.timing == 0 || info->rx_pos >= info->rx.size()) {
+        if (info->settings.timing)
+          ss_sleep(max(0, millisec - (int) (ss_millitime() - start)));
+        break;
+      }
+      if ((int) (ss_millitime() - start) > millisec)
+        break;
+      ss_sleep(1);
+      continue;
+    }
+
+    str[l++] = info->rx[info->rx_pos++];
+    info->rx_released++;
+    if (pattern && pattern[0] && l >= (int) strlen(pattern) &&
+        memcmp(str + l - strlen(pattern), pattern, strlen(pattern)) == 0) {
+      if (info->settings.debug)
+        printf("replay getstr %s: %s\n", pattern, str);
+      return l;
+    }
+  }
+
+  if (pattern && pattern[0])
+    return 0; // pattern not seen, same as a timeout on the real port
+  return l;
+}
+
+int replay_read(REPLAY_INFO* info, char* data, int size, int millisec) {
+  int l = 0;
+  DWORD start = ss_millitime();
+  while (l < size) {
+    size_t avail = min(replay_available(info), (size_t) (size - l));
+    if (avail > 0) {
+      memcpy(data + l, info->rx.data() + info->rx_pos, avail);
+      info->rx_pos += avail;
+      info->rx_released += avail;
+      l += avail;
+      continue;
+    }
+    if (info->settings.timing == 0 || info->rx_pos >= info->rx.size() ||
+        (int) (ss_millitime() - start) > millisec)
+      break;
+    ss_sleep(1);
+  }
+  return l;
+}
+
+//---- bus driver entry point ----------------------------------------
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+INT replay(INT cmd, ...)
+{
+  va_list argptr;
+  HNDLE hkey;
+  INT status, size, timeout;
+  void *info;
+  char *str, *pattern;
+
+  va_start(argptr, cmd);
+  status = FE_SUCCESS;
+
+  switch (cmd) {
+    case CMD_INIT:
+      hkey = va_arg(argptr, HNDLE);
+      info = va_arg(argptr, void *);
+      status = replay_init(hkey, (void**) info);
+      break;
+
+    case CMD_EXIT:
+      info = va_arg(argptr, void *);
+      status = replay_exit((REPLAY_INFO*) info);
+      break;
+
+    case CMD_NAME:
+      info = va_arg(argptr, void *);
+      str = va_arg(argptr, char *);
+      strcpy(str, "replay");
+      break;
+
+    case CMD_WRITE:
+      info = va_arg(argptr, void *);
+      str = va_arg(argptr, char *);
+      size = va_arg(argptr, int);
+      status = replay_puts((REPLAY_INFO*) info, str, size);
+      break;
+
+    case CMD_READ:
+      info = va_arg(argptr, void *);
+      str = va_arg(argptr, char *);
+      size = va_arg(argptr, INT);
+      timeout = va_arg(argptr, INT);
+      status = replay_read((REPLAY_INFO*) info, str, size, timeout);
+      break;
+
+    case CMD_PUTS:
+      info = va_arg(argptr, void *);
+      str = va_arg(argptr, char *);
+      status = replay_puts((REPLAY_INFO*) info, str, strlen(str));
+      break;
+
+    case CMD_GETS:
+      info = va_arg(argptr, void *);
+      str = va_arg(argptr, char *);
+      size = va_arg(argptr, INT);
+      pattern = va_arg(argptr, char *);
+      timeout = va_arg(argptr, INT);
+      status = replay_gets((REPLAY_INFO*) info, str, size, pattern, timeout);
+      break;
+
+    case CMD_DEBUG:
+      info = va_arg(argptr, void *);
+      status = va_arg(argptr, INT);
+      ((REPLAY_INFO*) info)->settings.debug = status;
+      status = FE_SUCCESS;
+      break;
+
+    default:
+      break;
+  }
+
+  va_end(argptr);
+
+  return status;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+//--------------------------------------------------------------------
@@ -1,9 +1,10 @@
 /********************************************************************\
 
-  Name:         dd_mcfd16.h
+  Name:         replay.h
   Created by:   Kolby Kiesling
 
-  Contents:     Device driver function declarations for Mesytec MCFD16.
+  Contents:     Bus driver that answers from a recorded rs232 log
+                instead of a device.
 
   $Id: $
 
@@ -11,8 +12,7 @@
 #ifdef __cplusplus
 extern "C" {
 #endif
-INT dd_mcfd16(INT cmd, ...);
+INT replay(INT cmd, ...);
 #ifdef __cplusplus
 }
 #endif
-